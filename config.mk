@@ -15,6 +15,11 @@ PLATFORM ?= native
 ENABLE_STATIC := 1
 ENABLE_SHARED := 0
 
+# Toolchain.
+#  gcc: Build with GCC.
+#  clang: Build with Clang.
+TOOLCHAIN ?= gcc
+
 # Build type.
 #  release: No debuggable.
 #  debug: Debuggable.
@@ -0,0 +1,4 @@
+EXECUTABLE := lock_bench
+OBJS := lock_bench.o
+# 以前の lock() の展開形はスタック上のトランポリンを使用するため, 実行可能スタックを明示する.
+EXTRA_LDFLAGS += $(if $(filter $(TOOLCHAIN),gcc),-z execstack)
@@ -15,6 +15,8 @@
 #define __ANTTQ_TASKQUEUE_H__
 
 struct TaskQueue;
+struct TaskPool;
+struct TaskGroup;
 
 /** @addtogroup cat_taskqueue Task Queue
  *  This module compose the Task Queue.
@@ -25,20 +27,45 @@ struct TaskQueue;
  *  タスク処理状態列挙子.
  */
 enum TaskStatus {
-    TS_ACK,     /**< タスク処理開始. */
-    TS_SUCCESS, /**< タスク処理完了. */
-    TS_FAIL,    /**< タスク処理失敗. */
-    TS_RETRY,   /**< タスク処理リトライ実施. */
-    TS_LENGTH   /**< タスク処理状態数. */
+    TS_ACK,      /**< タスク処理開始. */
+    TS_SUCCESS,  /**< タスク処理完了. */
+    TS_FAIL,     /**< タスク処理失敗. */
+    TS_RETRY,    /**< タスク処理リトライ実施. */
+    TS_EXPIRED,  /**< 期限切れのためタスク処理せず破棄. */
+    TS_DROPPED,  /**< キューが満杯のため, 新しいタスクに押し出されて破棄. */
+    TS_CANCELED, /**< Task Queue の終了のため, タスク処理せず破棄. */
+    TS_LENGTH    /**< タスク処理状態数. */
 };
 
+/**
+ *  タスク状態をマスクに変換するマクロ.
+ */
+#define TS_MASK(status) (1U << (status))
+
 /**
  *  タスク識別子.
  *
  *  タスクの予約時に発行されるタスクの識別子.
+ *  下位のビットはチケットの番号, 残りの上位ビットは予約ごとに進む世代で,
+ *  実行を終えたタスクの識別子は後から予約したタスクを指さない.
+ *  世代は, 63 ビットから容量に応じて決まるチケットの番号のビット数を除いた
+ *  ビット数を持ち, それを超える数の予約で一巡する.
  *  無効値は -1 とする.
  */
-typedef int16_t TaskId;
+typedef int64_t TaskId;
+
+/**
+ *  合流方針列挙子.
+ *
+ *  同じ合流キーの未実行のタスクがある場合に, 新たに予約されたタスクの引数の
+ *  扱いを指定する.
+ */
+enum CoalescePolicy {
+    CP_KEEP_FIRST, /**< 未実行のタスクの引数を維持し, 新しい引数は破棄する. */
+    CP_KEEP_LAST,  /**< 新しい引数で置き換え, 未実行のタスクの引数は破棄する. */
+    CP_MERGE,      /**< Merge() で 2 つの引数を 1 つに統合する. */
+    CP_LENGTH      /**< 合流方針数. */
+};
 
 /**
  *  タスク要素構造体.
@@ -52,17 +79,149 @@ struct TaskItem {
                                         /**< タスクの状態変化コールバック. */
     void *arg;                          /**< タスクに渡される引数. */
     int retry;                          /**< タスク失敗時のリトライ回数. */
+    int rate_class;                     /**< 流量制限クラス. 0 の場合は制限しない. */
+    unsigned int deadline_ms;           /**< 予約からの実行期限 (ミリ秒). 0 の場合は期限なし. */
+    unsigned int tag;                   /**< 一括取り消し用のタグ (0 〜 63). 0 の場合はタグなし. */
+    bool blocking;                      /**< ブロッキングする処理か. 専用のスレッドで実行される. */
+    bool priority;                      /**< 優先タスクか. 予備の容量を使用できる. */
+    bool fiber;                         /**< ファイバーで実行するか. AntTQ_Await() などで
+                                             Worker を塞がずに中断できる. */
+    unsigned int coalesce_key;          /**< 合流キー. 0 の場合は合流しない. */
+    enum CoalescePolicy coalesce;       /**< 合流時の引数の扱い. */
+    void *(*Merge)(void *pending, void *arg);
+                                        /**< 未実行のタスクの引数と新しい引数を統合する関数. */
 };
 
 /**
  *  タスク要素構造体の初期化子.
  */
-#define TASK_ITEM_INITIALIZER \
-    (struct TaskItem){        \
-        .Task = NULL,         \
-        .Callback = NULL,     \
-        .arg = NULL,          \
-        .retry = 0            \
+#define TASK_ITEM_INITIALIZER      \
+    (struct TaskItem){             \
+        .Task = NULL,              \
+        .Callback = NULL,          \
+        .arg = NULL,               \
+        .retry = 0,                \
+        .rate_class = 0,           \
+        .deadline_ms = 0,          \
+        .tag = 0,                  \
+        .blocking = false,         \
+        .priority = false,         \
+        .fiber = false,            \
+        .coalesce_key = 0,         \
+        .coalesce = CP_KEEP_FIRST, \
+        .Merge = NULL              \
+    }
+
+/**
+ *  タスク状態の記録構造体.
+ *
+ *  完了リングに記録され, AntTQ_Harvest() で取得する.
+ */
+struct TaskCompletion {
+    TaskId id;               /**< タスク識別子. */
+    enum TaskStatus status;  /**< タスク状態. */
+    intptr_t result;         /**< AntTQ_SetResult() で設定されたタスクの結果. */
+};
+
+/**
+ *  アイドル戦略列挙子.
+ *
+ *  キューが空になったワーカーが, 次のタスクを待つ方法を指定する.
+ *  ワーカーはスピン (pause), CPU の明け渡し (sched_yield), 休止 (条件変数待ち)
+ *  の順に段階的に待機する.
+ */
+enum IdlePolicy {
+    IP_BALANCED, /**< 直近のタスク到着間隔から次の到着が見込める場合のみスピンする. */
+    IP_LATENCY,  /**< 応答性優先. 常に上限までスピンしてから休止する. */
+    IP_POWER,    /**< 省電力優先. スピンせずに直ちに休止する. */
+    IP_LENGTH    /**< アイドル戦略数. */
+};
+
+/**
+ *  受け入れ方針列挙子.
+ *
+ *  キューが満杯の時に予約されたタスクの扱いを指定する.
+ */
+enum AdmissionPolicy {
+    AP_REJECT,      /**< 予約を拒否する. */
+    AP_DROP_OLDEST, /**< 最も古い未実行のタスクを TS_DROPPED で破棄して予約する. */
+    AP_CALLER_RUNS, /**< 予約せず, 呼び出し元のスレッドで直ちに実行する. */
+    AP_LENGTH       /**< 受け入れ方針数. */
+};
+
+/**
+ *  Task Queue 属性構造体.
+ */
+struct TaskQueueAttr {
+    enum IdlePolicy idle_policy; /**< アイドル戦略. */
+    unsigned int spin_ns;        /**< スピン時間の上限 (ナノ秒). 0 の場合は既定値. */
+    unsigned int yields;         /**< 休止前に CPU を明け渡す回数. */
+    unsigned int weight;         /**< Worker プール共有時の重み. 0 の場合は 1. */
+    size_t max_concurrency;      /**< 同時に実行するタスク数の上限. 0 の場合は無制限. */
+    size_t edf_capacity;         /**< 期限順に並べるタスク数の上限. 0 の場合は予約順.
+                                      上限を超えた期限付きタスクは予約順に並べる. */
+    size_t arg_slots;            /**< タスク引数スラブのサイズクラスごとの領域数. 0 の場合は使用しない. */
+    size_t completion_capacity;  /**< 完了リングの容量 (2 のべき乗). 0 の場合は使用しない. */
+    unsigned int completion_events;
+                                 /**< 完了リングに記録するタスク状態 (@ref TS_MASK の論理和).
+                                      0 の場合は TS_SUCCESS, TS_FAIL, TS_EXPIRED, TS_DROPPED. */
+    size_t blocking_workers;     /**< ブロッキングタスク用スレッド数の上限. 0 の場合は使用しない. */
+    void *(*WorkerInit)(void *ctx);
+                                 /**< Worker の開始時に呼び出す関数. 戻り値は
+                                      AntTQ_WorkerLocal() で取得できる. */
+    void (*WorkerFini)(void *local, void *ctx);
+                                 /**< Worker の終了時に呼び出す関数. */
+    void *worker_ctx;            /**< WorkerInit, WorkerFini に渡される引数. */
+    size_t scratch_bytes;        /**< Worker ごとの作業領域のバイト数. 0 の場合は使用しない. */
+    enum AdmissionPolicy admission;
+                                 /**< キューが満杯の時の受け入れ方針. */
+    size_t headroom;             /**< リトライと優先タスク用に予備とする容量. */
+    unsigned int watchdog_ms;    /**< タスクの実行時間の上限 (ミリ秒). 0 の場合は監視しない. */
+    void (*TaskStuck)(TaskId id, unsigned int elapsed_ms, void *ctx);
+                                 /**< 実行時間の上限を超えたタスクを報告する関数.
+                                      Watchdog のスレッドから, タスク 1 件につき 1 度呼ばれる. */
+    void *watchdog_ctx;          /**< TaskStuck に渡される引数. */
+    size_t spare_workers;        /**< 塞がれた Worker の代わりに起動する代替 Worker の数の上限.
+                                      0 の場合は報告のみ. */
+    size_t spawn_capacity;       /**< Worker ごとの子タスク用ローカルバッファの容量 (2 のべき乗).
+                                      0 の場合は子タスクを Task Queue に予約する. */
+    size_t fd_watches;           /**< 準備完了を待てる fd の数. 0 の場合は使用しない. */
+    size_t coalesce_slots;       /**< 合流キーの表の要素数 (2 のべき乗). 0 の場合は合流しない. */
+    size_t fiber_stacks;         /**< ファイバーの数. 同時に開始できるファイバーで実行するタスク数の
+                                      上限となる. 0 の場合は使用しない. */
+    size_t fiber_stack_bytes;    /**< ファイバーごとのスタックのバイト数. 0 の場合は既定値 (64 KiB). */
+};
+
+/**
+ *  Task Queue 属性構造体の初期化子.
+ */
+#define TASK_QUEUE_ATTR_INITIALIZER      \
+    (struct TaskQueueAttr){              \
+        .idle_policy = IP_BALANCED,      \
+        .spin_ns = 0,                    \
+        .yields = 4,                     \
+        .weight = 1,                     \
+        .max_concurrency = 0,            \
+        .edf_capacity = 0,               \
+        .arg_slots = 0,                  \
+        .completion_capacity = 0,        \
+        .completion_events = 0,          \
+        .blocking_workers = 0,           \
+        .WorkerInit = NULL,              \
+        .WorkerFini = NULL,              \
+        .worker_ctx = NULL,              \
+        .scratch_bytes = 0,              \
+        .admission = AP_REJECT,          \
+        .headroom = 0,                   \
+        .watchdog_ms = 0,                \
+        .TaskStuck = NULL,               \
+        .watchdog_ctx = NULL,            \
+        .spare_workers = 0,              \
+        .spawn_capacity = 0,             \
+        .fd_watches = 0,                 \
+        .coalesce_slots = 0,             \
+        .fiber_stacks = 0,               \
+        .fiber_stack_bytes = 0           \
     }
 
 /**
@@ -70,24 +229,212 @@ struct TaskItem {
  */
 struct TaskQueue *AntTQ_Init(size_t capacity, size_t workers);
 
+/**
+ *  属性を指定して Task Queue の初期化を行う.
+ */
+struct TaskQueue *AntTQ_InitAttr(size_t capacity, size_t workers,
+                                 const struct TaskQueueAttr *attr);
+
 /**
  *  Task Queue を破棄する.
  */
 void AntTQ_Term(struct TaskQueue *self);
 
+/**
+ *  複数の Task Queue が共有する Worker プールを生成する.
+ */
+struct TaskPool *AntTQ_PoolInit(size_t workers, const struct TaskQueueAttr *attr);
+
+/**
+ *  Worker プールを破棄する.
+ */
+void AntTQ_PoolTerm(struct TaskPool *pool);
+
+/**
+ *  Worker プールを共有する Task Queue の初期化を行う.
+ */
+struct TaskQueue *AntTQ_InitOnPool(struct TaskPool *pool, size_t capacity,
+                                   const struct TaskQueueAttr *attr);
+
 int AntTQ_Start(struct TaskQueue *self);
 int AntTQ_Stop(struct TaskQueue *self);
 
+/**
+ *  予約済みのタスクを呼び出し元のスレッドで実行する.
+ */
+ssize_t AntTQ_RunPending(struct TaskQueue *self, size_t max_tasks, uint64_t budget_ns);
+
 /**
  *  タスクを予約する.
  */
 TaskId AntTQ_Enqueue(struct TaskQueue *self, struct TaskItem *item);
 
+/**
+ *  タスク関数を登録する.
+ */
+int AntTQ_Register(struct TaskQueue *self, bool (*Task)(TaskId id, void *arg),
+                   bool (*Callback)(TaskId id, enum TaskStatus status, void *arg));
+
+/**
+ *  登録済みのタスク関数を予約する.
+ */
+TaskId AntTQ_EnqueueFn(struct TaskQueue *self, int function, void *arg);
+
+/**
+ *  実行中のタスクから子タスクを予約する.
+ */
+TaskId AntTQ_Spawn(struct TaskItem *item);
+
+/**
+ *  子タスクの完了を待つ.
+ */
+int AntTQ_Join(void);
+
+/**
+ *  実行中のタスクから, タスクの取り消しが要求されているかを判定する.
+ */
+bool AntTQ_IsCancelRequested(TaskId id);
+
+/**
+ *  実行中のタスクから, タスクの完了を待つ.
+ */
+int AntTQ_Await(TaskId id);
+
+/**
+ *  ファイバーで実行中のタスクを中断し, Worker を明け渡す.
+ */
+int AntTQ_YieldFiber(void);
+
+/**
+ *  fd の準備完了で予約されるタスクを登録する.
+ */
+TaskId AntTQ_EnqueueOnFd(struct TaskQueue *self, int fd, uint32_t events, struct TaskItem *item);
+
+/**
+ *  fd の監視を解除する.
+ */
+int AntTQ_UnwatchFd(struct TaskQueue *self, int fd);
+
+/**
+ *  タスクをすべての Worker で 1 回ずつ実行する.
+ */
+TaskId AntTQ_Broadcast(struct TaskQueue *self, struct TaskItem *item);
+
 /**
  *  タスクをキャンセルする.
  */
 int AntTQ_Cancel(struct TaskQueue *self, TaskId id);
 
+/**
+ *  識別子の範囲を指定してタスクをキャンセルする.
+ */
+int AntTQ_CancelRange(struct TaskQueue *self, TaskId lo, TaskId hi);
+
+/**
+ *  タグを指定してタスクをキャンセルする.
+ */
+int AntTQ_CancelTag(struct TaskQueue *self, unsigned int tag);
+
+/**
+ *  タスク引数の領域を確保する.
+ */
+void *AntTQ_AllocArg(struct TaskQueue *self, size_t size);
+
+/**
+ *  タスクに渡さなかったタスク引数の領域を解放する.
+ */
+void AntTQ_FreeArg(struct TaskQueue *self, void *arg);
+
+/**
+ *  Worker 固有のデータを取得する.
+ */
+void *AntTQ_WorkerLocal(void);
+
+/**
+ *  Worker の作業領域から領域を確保する.
+ */
+void *AntTQ_WorkerScratch(size_t size);
+
+/**
+ *  実行中のタスクの結果を設定する.
+ */
+int AntTQ_SetResult(intptr_t result);
+
+/**
+ *  完了リングに記録されたタスク状態を取得する.
+ */
+ssize_t AntTQ_Harvest(struct TaskQueue *self, struct TaskCompletion *out, size_t count);
+
+/**
+ *  完了リングへの記録を通知するファイル記述子を取得する.
+ */
+int AntTQ_GetCompletionFd(struct TaskQueue *self);
+
+/**
+ *  完了リングに記録できなかったタスク状態の数を取得する.
+ */
+ssize_t AntTQ_CompletionOverflow(struct TaskQueue *self);
+
+/**
+ *  流量制限クラスを作成する.
+ */
+int AntTQ_RateClassCreate(struct TaskQueue *self, const char *name, unsigned int rate,
+                          unsigned int burst, size_t capacity);
+
+/**
+ *  名前から流量制限クラスを検索する.
+ */
+int AntTQ_RateClassFind(struct TaskQueue *self, const char *name);
+
+/**
+ *  タスクグループを生成する.
+ */
+struct TaskGroup *AntTQ_GroupCreate(struct TaskQueue *self);
+
+/**
+ *  タスクグループを破棄する.
+ */
+void AntTQ_GroupDestroy(struct TaskGroup *group);
+
+/**
+ *  タスクグループに所属するタスクを予約する.
+ */
+TaskId AntTQ_GroupEnqueue(struct TaskGroup *group, struct TaskItem *item);
+
+/**
+ *  タスクグループに所属するタスクをすべての Worker で 1 回ずつ実行する.
+ */
+TaskId AntTQ_GroupBroadcast(struct TaskGroup *group, struct TaskItem *item);
+
+/**
+ *  タスクグループのタスクがすべて完了するまで待つ.
+ */
+int AntTQ_GroupWait(struct TaskGroup *group, int timeout_ms);
+
+/**
+ *  キューのタスクを実行しながら, タスクグループのタスクがすべて完了するまで待つ.
+ */
+int AntTQ_GroupHelpWait(struct TaskGroup *group, int timeout_ms);
+
+/**
+ *  タスクグループの未実行タスクをすべて取り消す.
+ */
+int AntTQ_GroupCancel(struct TaskGroup *group);
+
+/**
+ *  範囲を分割して並列に実行する.
+ */
+int AntTQ_ParallelFor(struct TaskQueue *self, size_t begin, size_t end, size_t grain,
+                      void (*fn)(size_t begin, size_t end, void *ctx), void *ctx);
+
+/**
+ *  範囲を分割して並列に集約する.
+ */
+int AntTQ_ParallelReduce(struct TaskQueue *self, size_t begin, size_t end, size_t grain,
+                         void (*fn)(size_t begin, size_t end, void *acc, void *ctx),
+                         void (*join)(void *acc, const void *other, void *ctx),
+                         void *result, size_t size, void *ctx);
+
 /** @} */
 
 #endif /* __ANTTQ_TASKQUEUE_H__ */
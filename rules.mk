@@ -33,7 +33,9 @@ INCS := -I. $(EXTRA_INCS)
 
 OPT_WARN := -Wall -Wextra -Wshadow -Wcast-align
 OPT_WARN += $(if $(filter $(WARN_AS_ERROR),1),-Werror)
-OPT_WARN += -Wno-clobbered # workarround for pthread_cleanup_push() bug
+ifeq ($(TOOLCHAIN),gcc)
+  OPT_WARN += -Wno-clobbered # workarround for pthread_cleanup_push() bug
+endif
 OPT_WARN += -Wno-missing-field-initializers
 OPT_OPTIM := $(if $(filter $(BUILD_TYPE),release),-O2,-Og)
 OPT_OPTIM += $(if $(or $(LIBRARY), $(filter-out $(BUILD_TYPE),release)),-fPIC)
@@ -42,6 +44,7 @@ ifneq ($(and $(filter-out $(BUILD_TYPE),release), $(filter $(ENABLE_SANITIZER),1
   OPT_DEBUG += -fsanitize=address -fsanitize=leak -fno-omit-frame-pointer
 endif
 OPT_DEP := -MMD -MP
+OPT_EH := -fexceptions # lock() releases its mutex when a thread is cancelled.
 
 OPTS := $(OPT_WARN) $(OPT_OPTIM) $(OPT_DEBUG) $(OPT_DEP)
 DEFS := -DMODULE_VERSION=\"$(VERSION)\"
@@ -49,7 +52,7 @@ DEFS += $(if $(NODEBUG),-DNODEBUG=$(NODEBUG))
 DEFS += $(if $(INTERNAL_TESTABLE),-DINTERNAL_TESTABLE=$(INTERNAL_TESTABLE))
 
 CPPFLAGS := $(DEFS) $(EXTRA_CPPFLAGS)
-CFLAGS := $(if $(CSTANDARD),-std=$(CSTANDARD)) $(OPTS) -fdiagnostics-color $(INCS) $(EXTRA_CFLAGS)
+CFLAGS := $(if $(CSTANDARD),-std=$(CSTANDARD)) $(OPTS) $(OPT_EH) -fdiagnostics-color $(INCS) $(EXTRA_CFLAGS)
 CXXFLAGS := $(if $(CXXSTANDARD),-std=$(CXXSTANDARD)) $(OPTS) -fdiagnostics-color $(INCS) $(EXTRA_CXXFLAGS)
 LDFLAGS := $(if $(or $(ENABLE_STATIC),$(ENABLE_SHARED)),-L$(ROOTDIR)/src) $(EXTRA_LDFLAGS)
 CLDLIBS := $(if $(or $(ENABLE_STATIC),$(ENABLE_SHARED)),-l$(PROJECT))
@@ -78,8 +81,15 @@ QCLEAN   = $(Q1:0=@echo "  CLEAN   $(MODULE)";)
 ifneq ($(DISABLE_CCACHE),1)
   CCACHE := $(shell which ccache)
 endif
-CC := $(CCACHE) $(CROSS_COMPILE)gcc
-CXX := $(CCACHE) $(CROSS_COMPILE)g++
+ifeq ($(TOOLCHAIN),gcc)
+  CC := $(CCACHE) $(CROSS_COMPILE)gcc
+  CXX := $(CCACHE) $(CROSS_COMPILE)g++
+else ifeq ($(TOOLCHAIN),clang)
+  CC := $(CCACHE) clang $(if $(CROSS_COMPILE),--target=$(CROSS_COMPILE:-=))
+  CXX := $(CCACHE) clang++ $(if $(CROSS_COMPILE),--target=$(CROSS_COMPILE:-=))
+else
+  $(error "$(TOOLCHAIN) Unknown toolchain")
+endif
 LD := $(CROSS_COMPILE)ld
 AR := $(CROSS_COMPILE)ar
 OBJCOPY := $(CROSS_COMPILE)objcopy
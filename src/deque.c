@@ -0,0 +1,186 @@
+/** @file       deque.c
+ *  @brief      Bounded work stealing deque implementation.
+ *
+ *              単一の所有者が後入れ先出しで利用し, 他のスレッドは反対側から
+ *              先入れ先出しで盗み出す.
+ *
+ *              Correct and Efficient Work-Stealing for Weak Memory Models
+ *
+ *              https://fzn.fr/readings/ppopp13.pdf
+ *
+ *  @author     t-kenji <protect.2501@gmail.com>
+ *  @date       2026-10-18 newly created.
+ *  @copyright  Copyright (c) 2026 t-kenji
+ *
+ *  This code is licensed under the MIT License.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "deque.h"
+
+static inline size_t SlotBytes(size_t val_bytes)
+{
+    size_t slot_bytes = val_bytes;
+    if (slot_bytes % 8) {
+        slot_bytes += 8 - (slot_bytes % 8);
+    }
+    return slot_bytes;
+}
+
+static inline void *SlotAt(struct Deque *self, ssize_t pos)
+{
+    return (void *)((uintptr_t)self->slots + (SlotBytes(self->val_bytes) * ((size_t)pos & self->mask)));
+}
+
+ssize_t Deque_ComputeSize(struct Deque *self, size_t val_bytes, size_t capacity)
+{
+    /* 位置からスロットをマスクで求めるため, 容量は 2 のべき乗に限る. */
+    if ((self == NULL) || (val_bytes == 0) || (capacity < 2) || ((capacity & (capacity - 1)) != 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *self = (struct Deque){
+        .slots = NULL,
+        .val_bytes = val_bytes,
+        .mask = capacity - 1,
+        .top = 0,
+        .bottom = 0,
+    };
+    return SlotBytes(val_bytes) * capacity;
+}
+
+int Deque_Bind(struct Deque *self, void *memory)
+{
+    if ((self == NULL) || (memory == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    self->slots = memory;
+    self->top = 0;
+    self->bottom = 0;
+
+    return 0;
+}
+
+int Deque_Unbind(struct Deque *self)
+{
+    if (self == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    self->slots = NULL;
+
+    return 0;
+}
+
+/**
+ *  所有者のみが呼び出せる.
+ */
+int Deque_Push(struct Deque *self, const void *val)
+{
+    if ((self == NULL) || (val == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ssize_t b = atomic_load_explicit(&self->bottom, memory_order_relaxed);
+    ssize_t t = atomic_load_explicit(&self->top, memory_order_acquire);
+    if ((size_t)(b - t) > self->mask) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(SlotAt(self, b), val, self->val_bytes);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&self->bottom, b + 1, memory_order_relaxed);
+
+    return 0;
+}
+
+/**
+ *  所有者のみが呼び出せる. 最後に追加した値を取り出す.
+ *  残り 1 つの値は, 盗み出す側と CAS で取り合う.
+ */
+int Deque_Pop(struct Deque *self, void *val)
+{
+    if ((self == NULL) || (val == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ssize_t b = atomic_load_explicit(&self->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&self->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    ssize_t t = atomic_load_explicit(&self->top, memory_order_relaxed);
+    if (b < t) {
+        atomic_store_explicit(&self->bottom, b + 1, memory_order_relaxed);
+        errno = ENOENT;
+        return -1;
+    }
+
+    memcpy(val, SlotAt(self, b), self->val_bytes);
+    if (b == t) {
+        bool won = atomic_compare_exchange_strong_explicit(&self->top, &t, t + 1,
+                                                           memory_order_seq_cst,
+                                                           memory_order_relaxed);
+        atomic_store_explicit(&self->bottom, b + 1, memory_order_relaxed);
+        if (!won) {
+            errno = ENOENT;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *  任意のスレッドが呼び出せる. 最も古い値を取り出す.
+ *  他のスレッドと取り合いになり取り出せなかった場合は, errno に EAGAIN を設定する.
+ *  CAS に失敗した場合は, 読み出した値を破棄する.
+ */
+int Deque_Steal(struct Deque *self, void *val)
+{
+    if ((self == NULL) || (val == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ssize_t t = atomic_load_explicit(&self->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    ssize_t b = atomic_load_explicit(&self->bottom, memory_order_acquire);
+    if (b <= t) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    memcpy(val, SlotAt(self, t), self->val_bytes);
+    if (!atomic_compare_exchange_strong_explicit(&self->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return 0;
+}
+
+bool Deque_IsEmpty(struct Deque *self)
+{
+    if (self == NULL) {
+        errno = EINVAL;
+        return true;
+    }
+
+    ssize_t t = atomic_load_explicit(&self->top, memory_order_acquire);
+    ssize_t b = atomic_load_explicit(&self->bottom, memory_order_acquire);
+    return b <= t;
+}
@@ -0,0 +1,37 @@
+/** @file       deque.h
+ *  @brief      Bounded work stealing deque implementation.
+ *
+ *              単一の所有者が後入れ先出しで利用し, 他のスレッドは反対側から
+ *              先入れ先出しで盗み出す.
+ *
+ *              Correct and Efficient Work-Stealing for Weak Memory Models
+ *
+ *              https://fzn.fr/readings/ppopp13.pdf
+ *
+ *  @author     t-kenji <protect.2501@gmail.com>
+ *  @date       2026-10-18 newly created.
+ *  @copyright  Copyright (c) 2026 t-kenji
+ *
+ *  This code is licensed under the MIT License.
+ */
+
+#ifndef __ANTTQ_DEQUE_H__
+#define __ANTTQ_DEQUE_H__
+
+struct Deque {
+    void *slots;
+    size_t val_bytes;
+    size_t mask;
+    alignas(64) _Atomic(ssize_t) top;
+    alignas(64) _Atomic(ssize_t) bottom;
+};
+
+ssize_t Deque_ComputeSize(struct Deque *self, size_t val_bytes, size_t capacity);
+int Deque_Bind(struct Deque *self, void *memory);
+int Deque_Unbind(struct Deque *self);
+int Deque_Push(struct Deque *self, const void *val);
+int Deque_Pop(struct Deque *self, void *val);
+int Deque_Steal(struct Deque *self, void *val);
+bool Deque_IsEmpty(struct Deque *self);
+
+#endif /* __ANTTQ_DEQUE_H__ */
@@ -0,0 +1,40 @@
+/** @file       futex.h
+ *  @brief      Thin wrapper of Linux futex.
+ *
+ *  @author     t-kenji <protect.2501@gmail.com>
+ *  @date       2026-10-18 newly created.
+ *  @copyright  Copyright (c) 2026 t-kenji
+ *
+ *  This code is licensed under the MIT License.
+ */
+
+#ifndef __ANTTQ_FUTEX_H__
+#define __ANTTQ_FUTEX_H__
+
+/**
+ *  @c addr の値が @c val である間, 待機する.
+ *
+ *  @param  [in]    addr    待機対象のアドレス.
+ *  @param  [in]    val     待機する条件の値.
+ *  @param  [in]    timeout 相対タイムアウト. NULL の場合は無期限.
+ *  @return 起床時は 0 が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ */
+static inline int FutexWait(_Atomic(uint32_t) *addr, uint32_t val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+/**
+ *  @c addr で待機しているスレッドを起床させる.
+ *
+ *  @param  [in]    addr    待機対象のアドレス.
+ *  @param  [in]    count   起床させるスレッドの最大数.
+ *  @return 起床させたスレッドの数が返る.
+ */
+static inline int FutexWake(_Atomic(uint32_t) *addr, int count)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+#endif /* __ANTTQ_FUTEX_H__ */
@@ -0,0 +1,197 @@
+/** @file       heap.c
+ *  @brief      Binary min-heap implementation.
+ *
+ *              スレッドセーフではないため, 排他は呼び出し側で行う.
+ *
+ *  @author     t-kenji <protect.2501@gmail.com>
+ *  @date       2026-10-18 newly created.
+ *  @copyright  Copyright (c) 2026 t-kenji
+ *
+ *  This code is licensed under the MIT License.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "heap.h"
+
+struct Entry {
+    uint64_t key;
+    uint8_t value[];
+};
+
+static inline size_t EntryBytes(size_t val_bytes)
+{
+    size_t entry_bytes = sizeof(struct Entry) + val_bytes;
+    if (entry_bytes % 8) {
+        entry_bytes += 8 - (entry_bytes % 8);
+    }
+    return entry_bytes;
+}
+
+static inline struct Entry *EntryAt(struct Heap *self, size_t index)
+{
+    return (struct Entry *)((uintptr_t)self->entries + (EntryBytes(self->val_bytes) * index));
+}
+
+/**
+ *  @c entry を @c index から根に向かって, 順序を満たす位置まで移動する.
+ */
+static void SiftUp(struct Heap *self, size_t index, const struct Entry *entry)
+{
+    size_t entry_bytes = EntryBytes(self->val_bytes);
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        struct Entry *up = EntryAt(self, parent);
+        if (up->key <= entry->key) {
+            break;
+        }
+        memcpy(EntryAt(self, index), up, entry_bytes);
+        index = parent;
+    }
+    memcpy(EntryAt(self, index), entry, entry_bytes);
+}
+
+/**
+ *  @c entry を @c index から葉に向かって, 順序を満たす位置まで移動する.
+ */
+static void SiftDown(struct Heap *self, size_t index, const struct Entry *entry)
+{
+    size_t entry_bytes = EntryBytes(self->val_bytes);
+    while (true) {
+        size_t child = (index * 2) + 1;
+        if (self->length <= child) {
+            break;
+        }
+        if (((child + 1) < self->length) && (EntryAt(self, child + 1)->key < EntryAt(self, child)->key)) {
+            child += 1;
+        }
+        struct Entry *down = EntryAt(self, child);
+        if (entry->key <= down->key) {
+            break;
+        }
+        memcpy(EntryAt(self, index), down, entry_bytes);
+        index = child;
+    }
+    memcpy(EntryAt(self, index), entry, entry_bytes);
+}
+
+ssize_t Heap_ComputeSize(struct Heap *self, size_t val_bytes, size_t capacity)
+{
+    if ((self == NULL) || (val_bytes == 0) || (capacity == 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *self = (struct Heap){
+        .entries = NULL,
+        .val_bytes = val_bytes,
+        .capacity = capacity,
+        .length = 0,
+    };
+    /* 末尾の 1 要素は, 移動中の要素を退避する作業領域として使う. */
+    return EntryBytes(val_bytes) * (capacity + 1);
+}
+
+int Heap_Bind(struct Heap *self, void *memory)
+{
+    if ((self == NULL) || (memory == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    self->entries = memory;
+    self->length = 0;
+
+    return 0;
+}
+
+int Heap_Unbind(struct Heap *self)
+{
+    if (self == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    self->entries = NULL;
+    self->length = 0;
+
+    return 0;
+}
+
+int Heap_Push(struct Heap *self, uint64_t key, const void *val)
+{
+    if ((self == NULL) || (val == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (self->capacity <= self->length) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    struct Entry *entry = EntryAt(self, self->capacity);
+    entry->key = key;
+    memcpy(entry->value, val, self->val_bytes);
+    self->length += 1;
+    SiftUp(self, self->length - 1, entry);
+
+    return 0;
+}
+
+int Heap_Pop(struct Heap *self, uint64_t *key, void *val)
+{
+    if ((self == NULL) || (val == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (self->length == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    struct Entry *top = EntryAt(self, 0);
+    if (key != NULL) {
+        *key = top->key;
+    }
+    memcpy(val, top->value, self->val_bytes);
+
+    self->length -= 1;
+    if (self->length > 0) {
+        struct Entry *entry = EntryAt(self, self->capacity);
+        memcpy(entry, EntryAt(self, self->length), EntryBytes(self->val_bytes));
+        SiftDown(self, 0, entry);
+    }
+
+    return 0;
+}
+
+int Heap_Peek(struct Heap *self, uint64_t *key)
+{
+    if ((self == NULL) || (key == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (self->length == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    *key = EntryAt(self, 0)->key;
+
+    return 0;
+}
+
+ssize_t Heap_Length(struct Heap *self)
+{
+    if (self == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return self->length;
+}
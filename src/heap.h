@@ -0,0 +1,29 @@
+/** @file       heap.h
+ *  @brief      Binary min-heap implementation.
+ *
+ *  @author     t-kenji <protect.2501@gmail.com>
+ *  @date       2026-10-18 newly created.
+ *  @copyright  Copyright (c) 2026 t-kenji
+ *
+ *  This code is licensed under the MIT License.
+ */
+
+#ifndef __ANTTQ_HEAP_H__
+#define __ANTTQ_HEAP_H__
+
+struct Heap {
+    void *entries;
+    size_t val_bytes;
+    size_t capacity;
+    size_t length;
+};
+
+ssize_t Heap_ComputeSize(struct Heap *self, size_t val_bytes, size_t capacity);
+int Heap_Bind(struct Heap *self, void *memory);
+int Heap_Unbind(struct Heap *self);
+int Heap_Push(struct Heap *self, uint64_t key, const void *val);
+int Heap_Pop(struct Heap *self, uint64_t *key, void *val);
+int Heap_Peek(struct Heap *self, uint64_t *key);
+ssize_t Heap_Length(struct Heap *self);
+
+#endif /* __ANTTQ_HEAP_H__ */
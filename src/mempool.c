@@ -34,16 +34,16 @@ struct Fragment {
         },               \
     }
 
-#define MEMORY_POOL_MAKER(p, b, c) \
-    (struct MemoryPool){           \
-        .pool = (p),               \
-        .val_bytes = (b),         \
-        .capacity = (c),           \
-        .freeable = 0,             \
-        .head = {                  \
-            .frag = 0,             \
-            .count = 0,            \
-        },                         \
+#define MEMORY_POOL_MAKER(p, b, c)   \
+    (struct MemoryPool){             \
+        .pool = (p),                 \
+        .val_bytes = (b),            \
+        .capacity = (c),             \
+        .freeable = 0,               \
+        .head = (struct MemoryNode){ \
+            .frag = 0,               \
+            .count = 0,              \
+        },                           \
     }
 
 #define max(a, b) (((a) > (b)) ? (a) : (b))
@@ -20,20 +20,20 @@ struct MemoryPool {
     void *pool;
     size_t val_bytes;
     size_t capacity;
-    size_t freeable;
-    alignas(8) struct MemoryNode head;
+    _Atomic(size_t) freeable;
+    alignas(8) _Atomic(struct MemoryNode) head;
 };
 
-#define MEMORY_POOL_INITIALIZER \
-    {                           \
-        .pool = NULL,           \
-        .val_bytes = 0,        \
-        .capacity = 0,          \
-        .freeable = 0,          \
-        .head = {               \
-            .frag = 0,          \
-            .count = 0,         \
-        },                      \
+#define MEMORY_POOL_INITIALIZER      \
+    {                                \
+        .pool = NULL,                \
+        .val_bytes = 0,              \
+        .capacity = 0,               \
+        .freeable = 0,               \
+        .head = (struct MemoryNode){ \
+            .frag = 0,               \
+            .count = 0,              \
+        },                           \
     }
 
 ssize_t MemoryPool_ComputeSize(struct MemoryPool *self, size_t val_bytes, size_t capacity);
@@ -1,3 +1,3 @@
 MODULE := anttq
 LIBRARY := lib$(PROJECT)
-OBJS := log.o mempool.o queue.o taskqueue.o
+OBJS := log.o mempool.o queue.o heap.o ring.o deque.o taskqueue.o
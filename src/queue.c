@@ -27,16 +27,16 @@
 #include "queue.h"
 
 struct Node {
-    struct Pointer next;
+    _Atomic(struct Pointer) next;
     uint8_t value[];
 };
 
-#define NodeMaker()     \
-    (struct Node){      \
-        .next = {       \
-            .ptr = 0,   \
-            .count = 0, \
-        },              \
+#define NodeMaker()               \
+    (struct Node){                \
+        .next = (struct Pointer){ \
+            .ptr = 0,             \
+            .count = 0,           \
+        },                        \
     }
 
 static inline bool Equals(struct Pointer a, struct Pointer b)
@@ -26,8 +26,8 @@ struct Pointer {
 struct Queue {
     struct MemoryPool mp;
     size_t val_bytes;
-    alignas(8) struct Pointer head;
-    alignas(8) struct Pointer tail;
+    alignas(8) _Atomic(struct Pointer) head;
+    alignas(8) _Atomic(struct Pointer) tail;
 };
 
 ssize_t Queue_ComputeSize(struct Queue *self, size_t val_bytes, size_t capacity);
@@ -0,0 +1,164 @@
+/** @file       ring.c
+ *  @brief      Bounded lock free ring buffer implementation.
+ *
+ *              複数の生産者と単一の消費者で利用する.
+ *
+ *              Bounded MPMC queue
+ *
+ *              https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ *
+ *  @author     t-kenji <protect.2501@gmail.com>
+ *  @date       2026-10-18 newly created.
+ *  @copyright  Copyright (c) 2026 t-kenji
+ *
+ *  This code is licensed under the MIT License.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "ring.h"
+
+struct Slot {
+    _Atomic(size_t) seq;
+    uint8_t value[];
+};
+
+static inline size_t SlotBytes(size_t val_bytes)
+{
+    size_t slot_bytes = sizeof(struct Slot) + val_bytes;
+    if (slot_bytes % 8) {
+        slot_bytes += 8 - (slot_bytes % 8);
+    }
+    return slot_bytes;
+}
+
+static inline struct Slot *SlotAt(struct Ring *self, size_t pos)
+{
+    return (struct Slot *)((uintptr_t)self->slots + (SlotBytes(self->val_bytes) * (pos & self->mask)));
+}
+
+ssize_t Ring_ComputeSize(struct Ring *self, size_t val_bytes, size_t capacity)
+{
+    /* 位置からスロットをマスクで求めるため, 容量は 2 のべき乗に限る. */
+    if ((self == NULL) || (val_bytes == 0) || (capacity < 2) || ((capacity & (capacity - 1)) != 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *self = (struct Ring){
+        .slots = NULL,
+        .val_bytes = val_bytes,
+        .mask = capacity - 1,
+        .tail = 0,
+        .head = 0,
+    };
+    return SlotBytes(val_bytes) * capacity;
+}
+
+int Ring_Bind(struct Ring *self, void *memory)
+{
+    if ((self == NULL) || (memory == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    self->slots = memory;
+    for (size_t i = 0; i <= self->mask; i += 1) {
+        SlotAt(self, i)->seq = i;
+    }
+    self->tail = 0;
+    self->head = 0;
+
+    return 0;
+}
+
+int Ring_Unbind(struct Ring *self)
+{
+    if (self == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    self->slots = NULL;
+
+    return 0;
+}
+
+/**
+ *  @c edge が NULL でない場合は, 空のリングに追加したかを格納する.
+ *  取り出し側と同じく, 位置の更新と確認の間に全順序のフェンスを置くことで,
+ *  空から非空への遷移をいずれか一方が必ず観測する.
+ */
+int Ring_Push(struct Ring *self, const void *val, bool *edge)
+{
+    if ((self == NULL) || (val == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct Slot *slot;
+    size_t pos = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    while (true) {
+        slot = SlotAt(self, pos);
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&self->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            errno = ENOMEM;
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&self->tail, memory_order_relaxed);
+        }
+    }
+    memcpy(slot->value, val, self->val_bytes);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    if (edge != NULL) {
+        atomic_thread_fence(memory_order_seq_cst);
+        *edge = (atomic_load_explicit(&self->head, memory_order_relaxed) == pos);
+    }
+
+    return 0;
+}
+
+int Ring_Pop(struct Ring *self, void *val)
+{
+    if ((self == NULL) || (val == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t pos = atomic_load_explicit(&self->head, memory_order_relaxed);
+    struct Slot *slot = SlotAt(self, pos);
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != (pos + 1)) {
+        errno = ENOENT;
+        return -1;
+    }
+    memcpy(val, slot->value, self->val_bytes);
+    atomic_store_explicit(&slot->seq, pos + self->mask + 1, memory_order_release);
+    atomic_store_explicit(&self->head, pos + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    return 0;
+}
+
+bool Ring_IsEmpty(struct Ring *self)
+{
+    if (self == NULL) {
+        errno = EINVAL;
+        return true;
+    }
+
+    size_t pos = atomic_load_explicit(&self->head, memory_order_relaxed);
+    return atomic_load_explicit(&SlotAt(self, pos)->seq, memory_order_acquire) != (pos + 1);
+}
@@ -0,0 +1,35 @@
+/** @file       ring.h
+ *  @brief      Bounded lock free ring buffer implementation.
+ *
+ *              複数の生産者と単一の消費者で利用する.
+ *
+ *              Bounded MPMC queue
+ *
+ *              https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ *
+ *  @author     t-kenji <protect.2501@gmail.com>
+ *  @date       2026-10-18 newly created.
+ *  @copyright  Copyright (c) 2026 t-kenji
+ *
+ *  This code is licensed under the MIT License.
+ */
+
+#ifndef __ANTTQ_RING_H__
+#define __ANTTQ_RING_H__
+
+struct Ring {
+    void *slots;
+    size_t val_bytes;
+    size_t mask;
+    alignas(64) _Atomic(size_t) tail;
+    alignas(64) _Atomic(size_t) head;
+};
+
+ssize_t Ring_ComputeSize(struct Ring *self, size_t val_bytes, size_t capacity);
+int Ring_Bind(struct Ring *self, void *memory);
+int Ring_Unbind(struct Ring *self);
+int Ring_Push(struct Ring *self, const void *val, bool *edge);
+int Ring_Pop(struct Ring *self, void *val);
+bool Ring_IsEmpty(struct Ring *self);
+
+#endif /* __ANTTQ_RING_H__ */
@@ -8,19 +8,34 @@
  *  This code is licensed under the MIT License.
  */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdatomic.h>
 #include <stdalign.h>
+#include <string.h>
 #include <sched.h>
+#include <time.h>
+#include <ucontext.h>
 #include <errno.h>
+#include <unistd.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/futex.h>
 #include <pthread.h>
 
 #include "utils.h"
-#include "bitflag.h"
+#include "futex.h"
+#include "mempool.h"
 #include "queue.h"
+#include "deque.h"
+#include "heap.h"
+#include "ring.h"
 #include "anttq.h"
 
 /**
@@ -29,25 +44,592 @@
 #define LIMIT_WORKERS (30)
 
 /**
- *  Task Queue 管理構造体.
+ *  1 つの Worker プールを共有できる Task Queue の最大数.
  */
-struct TaskQueue {
+#define LIMIT_QUEUES (16)
+
+/**
+ *  1 つの Task Queue に作成できる流量制限クラスの最大数.
+ */
+#define LIMIT_RATE_CLASSES (8)
+
+/**
+ *  流量制限クラス名の最大長 (終端文字を含む).
+ */
+#define RATE_CLASS_NAME_BYTES (16)
+
+/**
+ *  1 つの Task Queue に登録できるタスク関数の数 (未登録を示す 0 を含む).
+ */
+#define LIMIT_FUNCTIONS (64)
+
+/**
+ *  タスクの運搬情報のフラグのうち, 流量制限クラスを示すビット.
+ */
+#define CARGO_RATE_CLASS (0x0F)
+
+/**
+ *  全 Worker 宛てタスクであることを示す運搬情報のフラグ.
+ */
+#define CARGO_SHARED (0x10)
+
+/**
+ *  ブロッキングタスクであることを示す運搬情報のフラグ.
+ */
+#define CARGO_BLOCKING (0x20)
+
+/**
+ *  予備の容量を使用できる優先タスクであることを示す運搬情報のフラグ.
+ */
+#define CARGO_PRIORITY (0x40)
+
+/**
+ *  タスクの運搬情報のフラグ: ファイバーで実行する.
+ */
+#define CARGO_FIBER (0x80)
+
+/**
+ *  タスクに付けられるタグの数 (タグなしの 0 を含む).
+ */
+#define LIMIT_TAGS (64)
+
+/**
+ *  タスク引数スラブのサイズクラスの数.
+ */
+#define ARG_SIZE_CLASSES (4)
+
+/**
+ *  タスク引数スラブの最小サイズクラスのバイト数.
+ *  サイズクラスは 2 倍ずつ大きくなる.
+ */
+#define ARG_MIN_BYTES (32)
+
+/**
+ *  並列ループの参加者数の上限 (呼び出し元スレッドを含む).
+ */
+#define LIMIT_PARTICIPANTS (LIMIT_WORKERS + 1)
+
+/**
+ *  1 つの Task Queue で同時に配送中にできる全 Worker 宛てタスクの数.
+ */
+#define LIMIT_BROADCASTS (64)
+
+/**
+ *  キューの容量の上限.
+ *
+ *  キューとチケットの領域を圧縮ポインタで表せる範囲に収める.
+ */
+#define LIMIT_CAPACITY (1 << 24)
+
+/**
+ *  粒度の自動決定時に, 参加者 1 人あたりに割り当てるチャンク数.
+ */
+#define CHUNKS_PER_PARTICIPANT (8)
+
+/**
+ *  ブロッキングタスク用スレッドが, 待機後に終了するまでの時間 (ナノ秒).
+ */
+#define BLOCKING_KEEPALIVE_NS (1000000000)
+
+/**
+ *  スピン時間上限の既定値 (ナノ秒).
+ */
+#define DEFAULT_SPIN_NS (50000)
+
+/**
+ *  スピン中に経過時間を確認する間隔 (スピン回数).
+ */
+#define SPIN_CHECK_INTERVAL (64)
+
+/**
+ *  Reactor が 1 度に受け取る fd の準備完了イベントの数.
+ */
+#define REACTOR_EVENTS (16)
+
+/**
+ *  合流の受け付け状態.
+ *
+ *  未実行のタスクは MERGE_OPEN で合流を受け付け, 合流中の予約者は MERGE_BUSY に,
+ *  実行を開始する Worker は MERGE_SEALED に遷移させる.
+ */
+#define MERGE_OPEN (0)
+#define MERGE_BUSY (1)
+#define MERGE_SEALED (2)
+
+/**
+ *  Watchdog が実行時間を確認する間隔を, 実行時間の上限に対する比で表した除数.
+ */
+#define WATCHDOG_DIVISOR (4)
+
+/**
+ *  ファイバーのスタックの既定のバイト数.
+ */
+#define DEFAULT_FIBER_STACK_BYTES (64 * 1024)
+
+/**
+ *  Worker が実行中のタスクの記録.
+ *
+ *  Watchdog が監視する場合のみ, Worker がタスクの開始と終了時に更新する.
+ */
+struct WorkerStamp {
+    _Atomic(uint64_t) started; /**< 実行中のタスクの開始時刻. 0 の場合は実行していない. */
+    _Atomic(TaskId) id;        /**< 実行中のタスク識別子. */
+    uint64_t reported;         /**< Watchdog が最後に報告したタスクの開始時刻. */
+};
+
+/**
+ *  代替 Worker のスレッドの状態.
+ */
+enum SpareState {
+    SS_FREE,    /**< 未使用. */
+    SS_RUNNING, /**< 実行中. */
+    SS_LEAVING, /**< 自ら終了を決めた. */
+    SS_EXITED,  /**< 終了した. Watchdog の join 待ち. */
+};
+
+/**
+ *  代替 Worker の管理構造体.
+ */
+struct SpareSlot {
+    struct TaskPool *pool; /**< 代替 Worker が属する Worker プール. */
+    pthread_t thrd_id;     /**< 代替 Worker のスレッド ID. */
+    enum SpareState state; /**< スレッドの状態. watchdog_mutex で排他する. */
+};
+
+/**
+ *  Worker プール管理構造体.
+ *
+ *  複数の Task Queue が 1 つの Worker プールを共有できる.
+ *  共有する Task Queue 間は Deficit Round Robin で重み付けして公平に
+ *  スケジュールする.
+ */
+struct TaskPool {
     size_t num_of_workers;             /**< Worker の数. */
-    uint32_t total_tasks;              /**< 予約されたタスクの総数. */
     pthread_t thrd_ids[LIMIT_WORKERS]; /**< Worker のスレッド ID 配列. */
     pthread_mutex_t mutex;
     pthread_cond_t inqueue;
-    bool suspended;
-    bitflag(INT16_MAX) canceled;
+    enum IdlePolicy idle_policy;       /**< アイドル戦略. */
+    uint64_t spin_ns;                  /**< スピン時間の上限. */
+    unsigned int yields;               /**< 休止前に CPU を明け渡す回数. */
+    _Atomic(uint64_t) last_arrival;    /**< 直近のタスク到着時刻. */
+    _Atomic(uint64_t) arrival_interval;
+                                       /**< タスク到着間隔の移動平均. */
+    _Atomic(size_t) sleepers;          /**< 休止中の Worker の数. */
+    pthread_cond_t helpable;           /**< タスクを実行しながら待つ待機者の起床の通知. */
+    _Atomic(size_t) helpers;           /**< タスクを実行しながら待つ待機者の休止数. */
+    _Atomic(uint64_t) wakeup_at;       /**< 流量制限で保留中のタスクが実行可能になる時刻. */
+    bool exclusive;                    /**< 1 つの Task Queue が専有しているか. */
+    pthread_mutex_t drain_mutex;       /**< 終了処理中の Task Queue の待ち合わせの排他. */
+    pthread_cond_t drained;            /**< 終了処理中の Task Queue の実行中のタスクが減ったことの通知. */
+    _Atomic(size_t) draining;          /**< 実行中のタスクの完了を待つ終了処理の数. */
+    pthread_spinlock_t sched;          /**< スケジューラ状態の排他. */
+    size_t num_of_queues;              /**< 共有している Task Queue の数. */
+    size_t cursor;                     /**< Deficit Round Robin の巡回位置. */
+    struct TaskQueue *queues[LIMIT_QUEUES];
+                                       /**< 共有している Task Queue の配列. */
+    void *(*WorkerInit)(void *ctx);    /**< Worker の開始時に呼び出す関数. */
+    void (*WorkerFini)(void *local, void *ctx);
+                                       /**< Worker の終了時に呼び出す関数. */
+    void *worker_ctx;                  /**< Worker の開始, 終了時に渡される引数. */
+    size_t scratch_bytes;              /**< Worker ごとの作業領域のバイト数. */
+    _Atomic(size_t) num_of_started;    /**< 開始した Worker の数. Worker の番号の採番に用いる. */
+    _Atomic(struct BroadcastLetter *) mailboxes[LIMIT_WORKERS];
+                                       /**< Worker ごとの全 Worker 宛てタスクの受信箱. */
+    uint64_t watchdog_ns;              /**< タスクの実行時間の上限. 0 の場合は監視しない. */
+    void (*TaskStuck)(TaskId id, unsigned int elapsed_ms, void *ctx);
+                                       /**< 実行時間の上限を超えたタスクの報告先. */
+    void *watchdog_ctx;                /**< TaskStuck に渡される引数. */
+    pthread_t watchdog;                /**< Watchdog のスレッド ID. */
+    pthread_mutex_t watchdog_mutex;    /**< Watchdog と代替 Worker の状態の排他. */
+    pthread_cond_t watchdog_cond;      /**< Watchdog の停止の通知. */
+    _Atomic(bool) closing;             /**< Worker プールの破棄中か. */
+    _Atomic(size_t) stuck;             /**< 実行時間の上限を超えている Worker の数. */
+    size_t spare_limit;                /**< 代替 Worker の数の上限. */
+    size_t spares;                     /**< 実行中の代替 Worker の数. */
+    struct SpareSlot spare_slots[LIMIT_WORKERS];
+                                       /**< 代替 Worker の配列. */
+    struct WorkerStamp stamps[LIMIT_WORKERS];
+                                       /**< Worker ごとの実行中のタスクの記録. */
+    size_t spawn_capacity;             /**< Worker ごとのローカルバッファの容量. */
+    _Atomic(bool) spawned;             /**< ローカルバッファが使われたことがあるか. */
+    void *local_memory;                /**< ローカルバッファの領域. */
+    struct Deque locals[LIMIT_WORKERS];
+                                       /**< Worker ごとの子タスクのローカルバッファ. */
+    size_t fiber_limit;                /**< ファイバーの数. 0 の場合は使用しない. */
+    size_t fiber_stack_bytes;          /**< ファイバーごとのスタックのバイト数. */
+    size_t fiber_mapped;               /**< ファイバーのスタック領域のバイト数. */
+    void *fiber_memory;                /**< ファイバーのスタック領域. */
+    struct Fiber *fibers;              /**< ファイバーの配列. */
+    struct Fiber *free_fibers;         /**< 未使用のファイバーのリスト. */
+    pthread_spinlock_t fiber_lock;     /**< 未使用のファイバーのリストの排他. */
+};
+
+/**
+ *  タスク関数の組.
+ */
+struct TaskFunction {
+    bool (*Task)(TaskId id, void *arg); /**< タスクとして実行される関数. */
+    bool (*Callback)(TaskId id, enum TaskStatus status, void *arg);
+                                        /**< タスクの状態変化コールバック. */
+};
+
+/**
+ *  チケットと付加情報の領域の組.
+ *
+ *  Task Queue 本体と流量制限クラスがそれぞれ持ち, 保留中の流量制限クラスのタスクが
+ *  他のタスクの分を使い込まないようにする.
+ */
+struct TicketBook {
+    struct MemoryPool extensions; /**< タスクの付加情報の領域. */
+    struct MemoryPool tickets;    /**< 予約中のタスクのチケットの領域. */
+};
+
+/**
+ *  流量制限クラス管理構造体.
+ *
+ *  トークンバケットを GCRA (Generic Cell Rate Algorithm) で表現し,
+ *  理論到着時刻 1 つの CAS でトークンを取得する.
+ */
+struct RateClass {
+    char name[RATE_CLASS_NAME_BYTES];  /**< クラス名. */
+    uint64_t interval_ns;              /**< トークン 1 つの補充間隔. */
+    uint64_t tolerance_ns;             /**< バーストとして許容する前借り時間. */
+    _Atomic(uint64_t) tat;             /**< 理論到着時刻. */
+    _Atomic(size_t) pending;           /**< 保留中のタスク数. */
+    struct Queue que;                  /**< クラスのタスクを保持するキュー. */
+    struct TicketBook book;            /**< クラスのタスクのチケットと付加情報の領域. */
+    uint8_t reserved[];
+};
+
+/**
+ *  Task Queue 管理構造体.
+ */
+struct TaskQueue {
+    struct TaskPool *pool;             /**< タスクを実行する Worker プール. */
+    bool owns_pool;                    /**< Worker プールを専有しているか. */
+    _Atomic(uint64_t) total_tasks;     /**< 予約されたタスクの総数. */
+    _Atomic(bool) suspended;
+    unsigned int weight;               /**< スケジューリングの重み. */
+    size_t max_concurrency;            /**< 同時に実行するタスク数の上限. 0 は無制限. */
+    bool counted;                      /**< 実行中のタスク数を数えるか. */
+    _Atomic(size_t) running;           /**< 実行中のタスク数. */
+    long deficit;                      /**< Deficit Round Robin の残り実行可能数. */
+    _Atomic(size_t) num_of_classes;    /**< 流量制限クラスの数. */
+    _Atomic(size_t) rotation;          /**< 取り出し元を巡回する位置. */
+    struct RateClass *classes[LIMIT_RATE_CLASSES];
+                                       /**< 流量制限クラスの配列. */
+    pthread_spinlock_t edf;            /**< 期限付きタスクのヒープの排他. */
+    _Atomic(size_t) urgent;            /**< ヒープ内の期限付きタスクの数. */
+    struct Heap heap;                  /**< 期限付きタスクを期限順に保持するヒープ. */
+    _Atomic(uint32_t) generations[LIMIT_TAGS];
+                                       /**< タグごとの取り消し世代. */
+    pthread_spinlock_t registry;       /**< タスク関数の登録の排他. */
+    _Atomic(size_t) num_of_functions;  /**< 登録済みのタスク関数の数 (0 番を含む). */
+    struct TaskFunction functions[LIMIT_FUNCTIONS];
+                                       /**< 登録済みのタスク関数の表. */
+    struct TicketBook book;            /**< 流量制限クラス以外のタスクのチケットと付加情報の領域. */
+    unsigned int slot_bits;            /**< チケットの番号のうち, 領域内の位置のビット数. */
+    unsigned int ticket_bits;          /**< タスク識別子のうち, チケットの番号のビット数. */
+    uint64_t generation_mask;          /**< タスク識別子に収まる世代のマスク. */
+    _Atomic(uint32_t) *issued;         /**< 世代の下位ビットごとの, 発行したチケットの番号 + 1. */
+    _Atomic(size_t) displaced;         /**< 後の世代に issued の要素を譲った予約中のチケットの数. */
+    struct MemoryPool args[ARG_SIZE_CLASSES];
+                                       /**< サイズクラスごとのタスク引数スラブ. */
+    void *arg_memory;                  /**< タスク引数スラブの領域. */
+    unsigned int events;               /**< 完了リングに記録するタスク状態のマスク. */
+    _Atomic(size_t) overflow;          /**< 完了リングが満杯で記録できなかった数. */
+    struct Ring completions;           /**< タスク状態の記録を保持する完了リング. */
+    void *completion_memory;           /**< 完了リングの領域. */
+    int completion_fd;                 /**< 完了リングが空でなくなったことを通知する eventfd. */
+    pthread_mutex_t blocking_mutex;    /**< ブロッキングタスク用スレッドの状態の排他. */
+    pthread_cond_t blocking_cond;      /**< ブロッキングタスクの到着と, スレッドの終了の通知. */
+    size_t blocking_limit;             /**< ブロッキングタスク用スレッド数の上限. */
+    size_t blocking_threads;           /**< ブロッキングタスク用スレッドの数. */
+    size_t blocking_idle;              /**< 待機中のブロッキングタスク用スレッドの数. */
+    _Atomic(size_t) blocking_pending;  /**< 未実行のブロッキングタスクの数. */
+    _Atomic(bool) closing;             /**< Task Queue の破棄中か. */
+    _Atomic(size_t) letters;           /**< 配送済みで未実行の全 Worker 宛てタスクの数. */
+    _Atomic(size_t) broadcasts;        /**< 配送中の全 Worker 宛てタスクの数. */
+    struct Queue blocking_que;         /**< ブロッキングタスクを保持するキュー. */
+    enum AdmissionPolicy admission;    /**< キューが満杯の時の受け入れ方針. */
+    size_t headroom;                   /**< リトライと優先タスク用の予備の容量. */
+    size_t admission_limit;            /**< 通常のタスクが使用できるキューの容量. */
+    _Atomic(size_t) backlog;           /**< キューとヒープに積まれたタスクの数. 予備がある場合のみ数える. */
+    pthread_mutex_t reactor_mutex;     /**< fd の監視表と Reactor の状態の排他. */
+    int epoll_fd;                      /**< fd の準備完了を待つ epoll. -1 の場合は使用しない. */
+    int reactor_fd;                    /**< Reactor の停止を通知する eventfd. */
+    bool reactor_running;              /**< Reactor のスレッドを起動したか. */
+    pthread_t reactor;                 /**< Reactor のスレッド ID. */
+    size_t watch_limit;                /**< 監視できる fd の数. */
+    size_t num_of_watches;             /**< 監視している fd の数. */
+    size_t watch_mask;                 /**< fd の監視表の要素数 - 1. */
+    struct FdWatch *watches;           /**< fd の監視表. */
+    size_t coalesce_mask;              /**< 合流キーの表の要素数 - 1. */
+    _Atomic(uint64_t) *coalesce;       /**< 合流キーと付加情報の番号 + 1 の表. */
     struct Queue que;                  /**< タスクを保持するキュー. */
     uint8_t reserved[];
 };
 
+/**
+ *  待機者がいることを示すタスクグループ状態のビット.
+ */
+#define GROUP_WAITED (UINT32_C(1) << 31)
+
+/**
+ *  タスクを実行しながら待つ待機者がいることを示すタスクグループ状態のビット.
+ */
+#define GROUP_HELPED (UINT32_C(1) << 30)
+
+/**
+ *  タスクグループ状態のうち, 未完了タスク数を示すビット.
+ */
+#define GROUP_PENDING (GROUP_HELPED - 1)
+
+/**
+ *  タスクグループ管理構造体.
+ */
+struct TaskGroup {
+    struct TaskQueue *owner; /**< タスクを予約する Task Queue. */
+    _Atomic(uint32_t) state; /**< 未完了タスク数と待機者ビット. futex として使う. */
+    _Atomic(bool) canceled;  /**< グループ全体の取り消し要求. */
+};
+
+/**
+ *  並列ループの参加者ごとの担当範囲.
+ *
+ *  上位 32 bit に開始チャンク, 下位 32 bit に終了チャンクを保持し,
+ *  担当範囲の取り出しと分割を 1 回の CAS で行う.
+ */
+struct ParallelSpan {
+    alignas(64) _Atomic(uint64_t) span;
+};
+
+/**
+ *  並列ループ管理構造体.
+ *
+ *  呼び出し元スレッドのスタック上に置かれ, チャンクごとの確保は行わない.
+ */
+struct ParallelJob {
+    size_t begin;            /**< ループの開始値. */
+    size_t end;              /**< ループの終了値 (この値を含まない). */
+    size_t grain;            /**< 1 チャンクあたりの要素数. */
+    void (*For)(size_t begin, size_t end, void *ctx);
+                             /**< 並列ループ本体. */
+    void (*Reduce)(size_t begin, size_t end, void *acc, void *ctx);
+                             /**< 並列集約本体. */
+    void (*Join)(void *acc, const void *other, void *ctx);
+                             /**< 部分集約の結合関数. */
+    void *ctx;               /**< 本体に渡される引数. */
+    const void *identity;    /**< 集約の単位元. */
+    void *result;            /**< 集約結果. */
+    size_t size;             /**< 集約値のバイト数. */
+    pthread_mutex_t mutex;   /**< 集約結果の排他. */
+    size_t participants;     /**< 参加者数. */
+    _Atomic(size_t) joined;  /**< 参加済みのヘルパー数. */
+    struct TaskGroup group;  /**< ヘルパータスクのグループ. */
+    struct ParallelSpan slots[LIMIT_PARTICIPANTS];
+                             /**< 参加者ごとの担当範囲. */
+};
+
+/**
+ *  Worker ごとの状態.
+ *
+ *  Worker のスタック上に置かれ, Worker の実行中のみ有効である.
+ *  代替 Worker は受信箱を持たないため, 番号に LIMIT_WORKERS を用いる.
+ */
+struct WorkerContext {
+    struct TaskPool *pool;   /**< Worker が属する Worker プール. */
+    size_t index;            /**< Worker プール内の Worker の番号. */
+    void *local;             /**< WorkerInit() が返した Worker 固有のデータ. */
+    uint8_t *scratch;        /**< 作業領域. */
+    size_t used;             /**< 作業領域の使用済みバイト数. */
+    struct WorkerStamp *stamp;
+                             /**< 実行中のタスクの記録. 監視しない場合は NULL. */
+    struct Fiber *parked;    /**< 中断中のファイバーのリスト. */
+};
+
+/**
+ *  タスクの付加情報.
+ *
+ *  既定値以外の属性を持つタスクのみが Task Queue の領域から確保する.
+ */
+struct TaskExtension {
+    struct TaskFunction function; /**< 関数表に登録できなかったタスク関数. */
+    struct TaskGroup *group;      /**< 所属するタスクグループ. */
+    uint64_t deadline;            /**< 実行期限の時刻. 0 の場合は期限なし. */
+    uint32_t generation;          /**< 予約時のタグの取り消し世代. */
+    unsigned int tag;             /**< 一括取り消し用のタグ. */
+    int retry;                    /**< 残りのリトライ回数. */
+    uint32_t key;                 /**< 合流キー. 0 の場合は合流しない. */
+    _Atomic(uint32_t) merge;      /**< 合流の受け付け状態. */
+    TaskId id;                    /**< 合流した予約者に返すタスク識別子. */
+    void *arg;                    /**< 合流で更新されるタスクの引数. */
+};
+
+/**
+ *  取り消し要求を示すチケット状態のビット.
+ */
+#define TICKET_CANCELED (UINT64_C(1) << 0)
+
+/**
+ *  完了を待つ待機者がいることを示すチケット状態のビット.
+ */
+#define TICKET_AWAITED (UINT64_C(1) << 1)
+
+/**
+ *  後の世代のチケットに issued の要素を譲ったことを示すチケット状態のビット.
+ */
+#define TICKET_DISPLACED (UINT64_C(1) << 2)
+
+/**
+ *  チケット状態のうち, 世代を示すビットの位置.
+ */
+#define TICKET_GENERATION_SHIFT (3)
+
+/**
+ *  チケットの番号のうち, 領域の組を示すビット数.
+ *  0 は Task Queue 本体, 1 以上はその番号の流量制限クラスの領域を示す.
+ */
+#define TICKET_BOOK_BITS (4)
+
+_Static_assert(LIMIT_RATE_CLASSES < (1 << TICKET_BOOK_BITS), "rate classes must fit in book bits");
+
+/**
+ *  予約中のタスクが占有するチケット.
+ *
+ *  タスク識別子は, 下位の ticket_bits ビットがチケットの番号, 残りの上位ビットが
+ *  予約時の世代で, 世代が一致する間のみ有効となる. 取り消し要求はチケットが
+ *  保持するため, その領域は識別子の空間ではなく予約中のタスクの数に比例する.
+ *  チケットの番号は, 上位の TICKET_BOOK_BITS ビットが領域の組, 下位の slot_bits ビットが
+ *  領域内の位置となる. 付加情報も同じ形式の番号に 1 を加えて参照する.
+ */
+struct TaskTicket {
+    uint64_t link;           /**< メモリプールの空きリストが使用する領域. */
+    _Atomic(uint64_t) state; /**< 世代と TICKET_* ビット. 0 の場合は未使用. */
+    uint32_t extension;      /**< 付加情報の番号 + 1. 0 の場合は付加情報なし. */
+};
+
+_Static_assert((sizeof(struct TaskTicket) % 8) == 0, "TaskTicket must fill a pool fragment");
+_Static_assert((sizeof(struct TaskExtension) % 8) == 0, "TaskExtension must fill a pool fragment");
+
+/**
+ *  タスクの運搬情報.
+ *
+ *  キューのノードを小さく保つため, タスク関数は関数表の番号で, 識別子と
+ *  既定値以外の属性はチケットの番号で保持する.
+ */
 struct TaskItemCargo {
-    TaskId id;            /**< タスク識別子. */
-    struct TaskItem item; /**< タスク要素. */
+    uint32_t ticket;         /**< チケットの番号. */
+    uint8_t function;        /**< タスク関数の番号. 0 の場合は付加情報が保持する. */
+    uint8_t flags;           /**< 流量制限クラスと CARGO_* フラグ. */
+    void *arg;               /**< タスクに渡される引数. */
+};
+
+_Static_assert(sizeof(struct TaskItemCargo) <= 16, "TaskItemCargo must fit in 16 bytes");
+
+/**
+ *  fd の監視の要素.
+ *
+ *  fd をキーとする開番地法のハッシュ表に置かれる.
+ */
+struct FdWatch {
+    int fd;                       /**< 監視する fd. -1 の場合は空き. */
+    bool armed;                   /**< 準備完了を待っているか. */
+    struct TaskItemCargo cargo;   /**< 準備完了時に予約するタスク. */
+};
+
+/**
+ *  全 Worker 宛てタスクの受信箱の要素.
+ *
+ *  受信箱は Worker ごとの片方向リストで, 宛先の Worker だけが取り出す.
+ */
+struct BroadcastLetter {
+    struct BroadcastLetter *next; /**< 受信箱の次の要素. */
+    struct Broadcast *record;     /**< 配送元の全 Worker 宛てタスク. */
+};
+
+/**
+ *  全 Worker 宛てタスク管理構造体.
+ *
+ *  すべての Worker が実行し終えた時点で, 最後の Worker が解放する.
+ */
+struct Broadcast {
+    struct TaskQueue *owner;      /**< タスクを予約した Task Queue. */
+    struct TaskItemCargo cargo;   /**< 各 Worker が実行するタスク. */
+    _Atomic(size_t) remaining;    /**< 実行していない Worker の数. */
+    struct BroadcastLetter letters[LIMIT_WORKERS];
+                                  /**< Worker ごとの受信箱の要素. */
+};
+
+/**
+ *  ローカルバッファの要素.
+ *
+ *  Worker プールは複数の Task Queue で共有されるため, Task Queue も保持する.
+ */
+struct LocalTask {
+    struct TaskQueue *que;        /**< タスクを予約した Task Queue. */
+    struct TaskItemCargo cargo;   /**< 子タスク. */
+};
+
+/**
+ *  実行中のタスクの状態.
+ *
+ *  RunTask() のスタック上に置かれ, タスクの実行中のみ有効である.
+ */
+struct TaskFrame {
+    struct TaskQueue *que;        /**< 実行中のタスクの Task Queue. */
+    const struct TaskItemCargo *cargo;
+                                  /**< 実行中のタスク. */
+    TaskId id;                    /**< 実行中のタスク識別子. */
+    bool spawned;                 /**< 子タスクを生成したか. */
+    bool canceled;                /**< Task Queue の終了のため待機を打ち切ったか. */
+    struct TaskGroup children;    /**< 子タスクのグループ. */
 };
 
+/**
+ *  ファイバー管理構造体.
+ *
+ *  ファイバーはガードページ付きのスタックを持ち, タスク 1 件を実行する.
+ *  中断したファイバーは, 開始した Worker のみが再開する. スレッドを移らないため,
+ *  タスクの中でスレッドローカル変数を使用できる.
+ */
+struct Fiber {
+    struct Fiber *next;           /**< 未使用または中断中のリストの次の要素. */
+    void *stack;                  /**< スタックの先頭. */
+    ucontext_t context;           /**< ファイバーのコンテキスト. */
+    ucontext_t *caller;           /**< 再開した Worker のコンテキスト. */
+    struct TaskQueue *que;        /**< 実行中のタスクの Task Queue. */
+    struct TaskItemCargo cargo;   /**< 実行中のタスク. */
+    struct TaskFrame *frame;      /**< 中断時のタスクの状態. */
+    intptr_t *result;             /**< 中断時のタスクの結果の格納先. */
+    struct TaskTicket *awaited;   /**< 完了を待つタスクのチケット. NULL の場合は待っていない. */
+    uint64_t generation;          /**< 完了を待つタスクの世代. */
+    bool done;                    /**< タスクを実行し終えたか. */
+};
+
+/**
+ *  実行中のタスクの結果の格納先.
+ *
+ *  タスクの実行中のみ設定される. タスクの中で別のタスクを実行する場合に備え,
+ *  RunTask() は元の値を退避して復元する.
+ */
+static _Thread_local intptr_t *task_result = NULL;
+
+/**
+ *  実行中の Worker の状態. Worker 以外のスレッドでは NULL である.
+ */
+static _Thread_local struct WorkerContext *current_worker = NULL;
+
+/**
+ *  実行中のタスクの状態. タスクの実行中以外は NULL である.
+ */
+static _Thread_local struct TaskFrame *current_frame = NULL;
+
+/**
+ *  実行中のファイバー. ファイバーの実行中以外は NULL である.
+ */
+static _Thread_local struct Fiber *current_fiber = NULL;
+
 /**
  *  何もしないタスク状態変化コールバック.
  *
@@ -63,229 +645,4842 @@ static bool NullCallback(TaskId id MAYBE_UNUSED, enum TaskStatus status MAYBE_UN
 }
 
 /**
- *  予約されたタスクの総数を更新する.
+ *  単調増加する現在時刻を取得する.
+ *
+ *  @return 現在時刻 (ナノ秒) が返る.
+ */
+static inline uint64_t MonotonicNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/**
+ *  単調増加する時刻を条件変数の待機時刻に変換する.
+ *
+ *  @param  [in]    ns  時刻 (ナノ秒).
+ *  @return 待機時刻が返る.
+ */
+static inline struct timespec ToTimespec(uint64_t ns)
+{
+    return (struct timespec){
+        .tv_sec = ns / 1000000000,
+        .tv_nsec = ns % 1000000000,
+    };
+}
+
+/**
+ *  予約されたタスクの総数を更新する.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @return     タスクの総数が返る.
+ *  @pre        @c self の非 NULL は呼び出し側で保証する.
+ */
+static uint64_t IncrementTotalTasks(struct TaskQueue *self)
+{
+    return atomic_fetch_add(&self->total_tasks, 1) + 1;
+}
+
+/**
+ *  タスクの到着を記録し, 到着間隔の移動平均を更新する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @pre    @c self の非 NULL は呼び出し側で保証する.
+ */
+static void RecordArrival(struct TaskPool *self)
+{
+    if (self->idle_policy == IP_POWER) {
+        return;
+    }
+
+    uint64_t now = MonotonicNs();
+    uint64_t prev = atomic_exchange_explicit(&self->last_arrival, now, memory_order_relaxed);
+    if ((prev != 0) && (prev < now)) {
+        uint64_t interval = atomic_load_explicit(&self->arrival_interval, memory_order_relaxed);
+        uint64_t delta = now - prev;
+        interval = (interval == 0) ? delta : (interval - (interval / 8) + (delta / 8));
+        atomic_store_explicit(&self->arrival_interval, interval, memory_order_relaxed);
+    }
+}
+
+/**
+ *  アイドル戦略と到着間隔から, スピンする時間を決定する.
+ *
+ *  到着が途絶えている場合や, 次の到着がスピン時間の上限内に見込めない場合は
+ *  スピンしない.
+ *
+ *  @param  [in]    self    Worker プール.
+ *  @return スピンする時間 (ナノ秒) が返る.
+ */
+static uint64_t SpinBudget(struct TaskPool *self)
+{
+    uint64_t interval = atomic_load_explicit(&self->arrival_interval, memory_order_relaxed);
+    uint64_t expected = interval * 2;
+
+    switch (self->idle_policy) {
+    case IP_LATENCY:
+        return ((interval != 0) && (expected < self->spin_ns)) ? expected : self->spin_ns;
+    case IP_BALANCED:
+        if ((interval == 0) || (self->spin_ns < expected)) {
+            return 0;
+        }
+        uint64_t last = atomic_load_explicit(&self->last_arrival, memory_order_relaxed);
+        uint64_t now = MonotonicNs();
+        return ((last < now) && (self->spin_ns < (now - last))) ? 0 : expected;
+    default:
+        return 0;
+    }
+}
+
+/**
+ *  流量制限で保留中のタスクが実行可能になる時刻を Worker プールに通知する.
+ *
+ *  休止する Worker は, 通知された時刻のうち最も早い時刻に起床する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [in]        at      実行可能になる時刻.
+ */
+static void NoteWakeup(struct TaskPool *self, uint64_t at)
+{
+    uint64_t orig = atomic_load(&self->wakeup_at);
+    while (((orig == 0) || (at < orig))
+           && !atomic_compare_exchange_weak(&self->wakeup_at, &orig, at)) {
+    }
+}
+
+/**
+ *  流量制限クラスのトークンを 1 つ取得する.
+ *
+ *  @param  [in,out]    klass   流量制限クラス.
+ *  @param  [in]        now     現在時刻.
+ *  @return 取得できた場合は true が返る.
+ */
+static bool TakeToken(struct RateClass *klass, uint64_t now)
+{
+    uint64_t next, tat = atomic_load(&klass->tat);
+    do {
+        if ((now + klass->tolerance_ns) < tat) {
+            return false;
+        }
+        next = ((tat < now) ? now : tat) + klass->interval_ns;
+    } while (!atomic_compare_exchange_weak(&klass->tat, &tat, next));
+
+    return true;
+}
+
+/**
+ *  チケットか付加情報の番号から, 領域の組を取得する.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    number  チケットか付加情報の番号.
+ *  @return 領域の組が返る.
+ */
+static inline struct TicketBook *BookOf(struct TaskQueue *self, uint32_t number)
+{
+    uint32_t book = number >> self->slot_bits;
+    return (book == 0) ? &self->book : &self->classes[book - 1]->book;
+}
+
+/**
+ *  チケットか付加情報の番号から, 領域内の位置を取り出す.
+ *
+ *  領域はメモリプールの要素を隙間なく並べたものであるため,
+ *  位置は領域の先頭からの要素数となる.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    number  チケットか付加情報の番号.
+ *  @return 領域内の位置が返る.
+ */
+static inline uint32_t SlotOf(struct TaskQueue *self, uint32_t number)
+{
+    return number & ((UINT32_C(1) << self->slot_bits) - 1);
+}
+
+/**
+ *  番号からチケットを取得する.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    number  チケットの番号.
+ *  @return チケットが返る.
+ */
+static inline struct TaskTicket *TicketAt(struct TaskQueue *self, uint32_t number)
+{
+    return &((struct TaskTicket *)BookOf(self, number)->tickets.pool)[SlotOf(self, number)];
+}
+
+/**
+ *  番号から付加情報を取得する.
+ *
+ *  @param  [in]    self        Task Queue オブジェクト.
+ *  @param  [in]    extension   付加情報の番号 + 1.
+ *  @return 付加情報が返る.
+ */
+static inline struct TaskExtension *ExtensionAt(struct TaskQueue *self, uint32_t extension)
+{
+    uint32_t number = extension - 1;
+    return &((struct TaskExtension *)BookOf(self, number)->extensions.pool)[SlotOf(self, number)];
+}
+
+/**
+ *  タスクが占有するチケットを取得する.
+ *
+ *  予約中のタスクは必ずチケットを持つため, NULL は返らない.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    cargo   タスクの運搬情報.
+ *  @return チケットが返る.
+ */
+static inline struct TaskTicket *CargoTicket(struct TaskQueue *self,
+                                             const struct TaskItemCargo *cargo)
+{
+    return TicketAt(self, cargo->ticket);
+}
+
+/**
+ *  タスク識別子から世代を取り出す.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    id      タスク識別子.
+ *  @return 世代が返る.
+ */
+static inline uint64_t IdGeneration(struct TaskQueue *self, TaskId id)
+{
+    return (uint64_t)id >> self->ticket_bits;
+}
+
+/**
+ *  タスクの識別子を取得する.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    cargo   タスクの運搬情報.
+ *  @return タスク識別子が返る.
+ */
+static inline TaskId CargoId(struct TaskQueue *self, const struct TaskItemCargo *cargo)
+{
+    uint64_t state = atomic_load_explicit(&CargoTicket(self, cargo)->state, memory_order_relaxed);
+    return (TaskId)(((state >> TICKET_GENERATION_SHIFT) << self->ticket_bits) | cargo->ticket);
+}
+
+/**
+ *  タスクの付加情報を取得する.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    cargo   タスクの運搬情報.
+ *  @return 付加情報が返る. 付加情報がない場合は NULL が返る.
+ */
+static inline struct TaskExtension *CargoExtension(struct TaskQueue *self,
+                                                   const struct TaskItemCargo *cargo)
+{
+    uint32_t extension = CargoTicket(self, cargo)->extension;
+    if (extension == 0) {
+        return NULL;
+    }
+    return ExtensionAt(self, extension);
+}
+
+/**
+ *  付加情報を確保する.
+ *
+ *  流量制限クラスの領域が枯渇している場合は, Task Queue 本体の領域から確保する.
+ *
+ *  @param  [in,out]    self        Task Queue オブジェクト.
+ *  @param  [in]        book        確保する領域の組.
+ *  @param  [out]       extension   確保した付加情報の番号 + 1.
+ *  @return 成功時は, 付加情報が返る.
+ *          失敗時は, NULL が返り, errno が適切に設定される.
+ */
+static struct TaskExtension *AllocExtension(struct TaskQueue *self, uint32_t book,
+                                            uint32_t *extension)
+{
+    uint32_t number = book << self->slot_bits;
+    struct MemoryPool *mp = &BookOf(self, number)->extensions;
+    struct TaskExtension *ext = (struct TaskExtension *)MemoryPool_Alloc(mp);
+    if ((ext == NULL) && (book != 0)) {
+        number = 0;
+        mp = &self->book.extensions;
+        ext = (struct TaskExtension *)MemoryPool_Alloc(mp);
+    }
+    if (ext == NULL) {
+        return NULL;
+    }
+    *extension = (number | (uint32_t)(ext - (struct TaskExtension *)mp->pool)) + 1;
+
+    return ext;
+}
+
+/**
+ *  付加情報を解放する.
+ *
+ *  @param  [in,out]    self        Task Queue オブジェクト.
+ *  @param  [in]        extension   付加情報の番号 + 1. 0 の場合は何もしない.
+ */
+static void FreeExtension(struct TaskQueue *self, uint32_t extension)
+{
+    if (extension != 0) {
+        MemoryPool_Free(&BookOf(self, extension - 1)->extensions, ExtensionAt(self, extension));
+    }
+}
+
+/**
+ *  世代からチケットを引けるよう, 発行したチケットを issued に記録する.
+ *
+ *  issued の要素数は領域内の位置の空間と同じで, 世代の下位ビットで位置を決める.
+ *  要素に予約中の以前の世代のチケットが残っている場合は, そのチケットに
+ *  TICKET_DISPLACED を立てて displaced に数え, AntTQ_CancelRange() が
+ *  issued だけでは見つけられないチケットがあることを知らせる.
+ *
+ *  @param  [in,out]    self        Task Queue オブジェクト.
+ *  @param  [in]        generation  発行したチケットの世代.
+ *  @param  [in]        number      発行したチケットの番号.
+ */
+static void RecordIssued(struct TaskQueue *self, uint64_t generation, uint32_t number)
+{
+    uint64_t mask = (UINT64_C(1) << self->slot_bits) - 1;
+    _Atomic(uint32_t) *slot = &self->issued[generation & mask];
+    uint32_t prev = atomic_load(slot);
+    do {
+        if ((prev == 0) || (prev == (number + 1))) {
+            continue;
+        }
+        struct TaskTicket *ticket = TicketAt(self, prev - 1);
+        atomic_fetch_add(&self->displaced, 1);
+        uint64_t state = atomic_load(&ticket->state);
+        do {
+            uint64_t other = state >> TICKET_GENERATION_SHIFT;
+            if ((state == 0) || ((state & TICKET_DISPLACED) != 0) || (other == generation)
+                || ((other & mask) != (generation & mask))) {
+                atomic_fetch_sub(&self->displaced, 1);
+                break;
+            }
+        } while (!atomic_compare_exchange_weak(&ticket->state, &state, state | TICKET_DISPLACED));
+    } while (!atomic_compare_exchange_weak(slot, &prev, number + 1));
+}
+
+/**
+ *  チケットを発行する.
+ *
+ *  世代は予約の総数から求めるため, 解放したチケットを再利用しても以前の
+ *  識別子とは一致しない. 世代はタスク識別子のチケットの番号以外のビットを
+ *  すべて使うが, それを超える数の予約で一巡する.
+ *  流量制限クラスの領域が枯渇している場合は, Task Queue 本体の領域から発行する.
+ *
+ *  @param  [in,out]    self        Task Queue オブジェクト.
+ *  @param  [in]        book        発行する領域の組.
+ *  @param  [in]        extension   タスクの付加情報の番号 + 1. 付加情報がない場合は 0.
+ *  @param  [out]       number      発行したチケットの番号.
+ *  @return 成功時は, 0 が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ */
+static int IssueTicket(struct TaskQueue *self, uint32_t book, uint32_t extension,
+                       uint32_t *number)
+{
+    uint32_t base = book << self->slot_bits;
+    struct MemoryPool *mp = &BookOf(self, base)->tickets;
+    struct TaskTicket *ticket = (struct TaskTicket *)MemoryPool_Alloc(mp);
+    if ((ticket == NULL) && (book != 0)) {
+        base = 0;
+        mp = &self->book.tickets;
+        ticket = (struct TaskTicket *)MemoryPool_Alloc(mp);
+    }
+    if (ticket == NULL) {
+        return -1;
+    }
+    /* 世代 0 は未使用のチケットを表すため飛ばす. */
+    uint64_t generation = IncrementTotalTasks(self) & self->generation_mask;
+    if (generation == 0) {
+        generation = IncrementTotalTasks(self) & self->generation_mask;
+    }
+    ticket->extension = extension;
+    atomic_store_explicit(&ticket->state, generation << TICKET_GENERATION_SHIFT,
+                          memory_order_release);
+    *number = base | (uint32_t)(ticket - (struct TaskTicket *)mp->pool);
+    RecordIssued(self, generation, *number);
+
+    return 0;
+}
+
+/**
+ *  タスク識別子からチケットを取得する.
+ *
+ *  利用者から渡された識別子のため, チケットの番号が作成済みの領域内かを確認する.
+ *  世代は確認しない.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    id      タスク識別子.
+ *  @return 成功時は, チケットが返る.
+ *          失敗時は, NULL が返り, errno が適切に設定される.
+ */
+static struct TaskTicket *FindTicket(struct TaskQueue *self, TaskId id)
+{
+    uint32_t number = (uint64_t)id & ((UINT64_C(1) << self->ticket_bits) - 1);
+    if ((id < 0)
+        || (atomic_load_explicit(&self->num_of_classes, memory_order_acquire)
+            < (number >> self->slot_bits))
+        || (BookOf(self, number)->tickets.capacity <= SlotOf(self, number))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return TicketAt(self, number);
+}
+
+/**
+ *  チケットとタスクの付加情報を解放する.
+ *
+ *  AntTQ_Await() で完了を待つ待機者がいる場合は, 待機者と, 中断中のファイバーを
+ *  持つ Worker を起床させる.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in]        cargo   タスクの運搬情報.
+ */
+static void ReleaseTicket(struct TaskQueue *self, const struct TaskItemCargo *cargo)
+{
+    struct TaskTicket *ticket = CargoTicket(self, cargo);
+    FreeExtension(self, ticket->extension);
+    uint64_t state = atomic_exchange_explicit(&ticket->state, 0, memory_order_acq_rel);
+    MemoryPool_Free(&BookOf(self, cargo->ticket)->tickets, ticket);
+    if ((state & TICKET_DISPLACED) != 0) {
+        atomic_fetch_sub(&self->displaced, 1);
+    }
+
+    if ((state & TICKET_AWAITED) != 0) {
+        struct TaskPool *pool = self->pool;
+        lock (&pool->mutex) {
+            pthread_cond_broadcast(&pool->helpable);
+            if (pool->fiber_limit > 0) {
+                pthread_cond_broadcast(&pool->inqueue);
+            }
+        }
+    }
+}
+
+/**
+ *  チケットに完了を待つ待機者がいることを記録する.
+ *
+ *  @param  [in,out]    ticket      待つタスクのチケット.
+ *  @param  [in]        generation  待つタスクの世代.
+ *  @return 待つタスクが実行を終えていない場合は true が返る.
+ */
+static bool MarkAwaited(struct TaskTicket *ticket, uint64_t generation)
+{
+    uint64_t state = atomic_load(&ticket->state);
+    do {
+        if ((state >> TICKET_GENERATION_SHIFT) != generation) {
+            return false;
+        }
+        if ((state & TICKET_AWAITED) != 0) {
+            return true;
+        }
+    } while (!atomic_compare_exchange_weak(&ticket->state, &state, state | TICKET_AWAITED));
+
+    return true;
+}
+
+/**
+ *  合流キーの表の要素を取得する.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    key     合流キー.
+ *  @return 合流キーに対応する表の要素が返る.
+ */
+static inline _Atomic(uint64_t) *CoalesceSlot(struct TaskQueue *self, uint32_t key)
+{
+    return &self->coalesce[(key * UINT32_C(2654435761)) & self->coalesce_mask];
+}
+
+/**
+ *  合流キーの表の要素の値を生成する.
+ *
+ *  @param  [in]    key         合流キー.
+ *  @param  [in]    extension   付加情報の番号 + 1.
+ *  @return 表の要素の値が返る.
+ */
+static inline uint64_t CoalesceEntry(uint32_t key, uint32_t extension)
+{
+    return ((uint64_t)key << 32) | extension;
+}
+
+/**
+ *  タスクへの合流を締め切る.
+ *
+ *  合流中の予約者がいる場合は, その完了を待つ.
+ *  以降はタスクの引数が変わらないため, 合流で更新された引数を運搬情報に反映する.
+ *
+ *  @param  [in]        self    Task Queue オブジェクト.
+ *  @param  [in,out]    cargo   タスクの運搬情報.
+ */
+static void SealCoalesced(struct TaskQueue *self, struct TaskItemCargo *cargo)
+{
+    struct TaskExtension *ext = CargoExtension(self, cargo);
+    if ((ext == NULL) || (ext->key == 0)) {
+        return;
+    }
+
+    uint32_t state = MERGE_OPEN;
+    while (!atomic_compare_exchange_weak(&ext->merge, &state, MERGE_SEALED)) {
+        if (state == MERGE_SEALED) {
+            return;
+        }
+        state = MERGE_OPEN;
+        cpu_relax();
+    }
+    /* 表が別のタスクに置き換えられている場合は, そのままにする. */
+    uint64_t entry = CoalesceEntry(ext->key, CargoTicket(self, cargo)->extension);
+    atomic_compare_exchange_strong(CoalesceSlot(self, ext->key), &entry, 0);
+    cargo->arg = ext->arg;
+}
+
+/**
+ *  タスクのタスク関数を取得する.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    cargo   タスク.
+ *  @return タスク関数が返る.
+ */
+static inline const struct TaskFunction *CargoFunction(struct TaskQueue *self,
+                                                       const struct TaskItemCargo *cargo)
+{
+    if (cargo->function != 0) {
+        return &self->functions[cargo->function];
+    }
+    return &CargoExtension(self, cargo)->function;
+}
+
+/**
+ *  関数表からタスク関数を検索する.
+ *
+ *  @param  [in]    self        Task Queue オブジェクト.
+ *  @param  [in]    function    検索するタスク関数.
+ *  @return 見つかった場合は関数表の番号が返る. 見つからない場合は 0 が返る.
+ */
+static int FindFunction(struct TaskQueue *self, const struct TaskFunction *function)
+{
+    size_t num_of_functions = atomic_load_explicit(&self->num_of_functions, memory_order_acquire);
+    for (size_t i = 1; i < num_of_functions; i += 1) {
+        if ((self->functions[i].Task == function->Task)
+            && (self->functions[i].Callback == function->Callback)) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *  関数表にタスク関数を登録する.
+ *
+ *  登録済みの場合は, 登録済みの番号を返す.
+ *  関数表の要素は登録後に変更しないため, 参照側は排他しない.
+ *
+ *  @param  [in,out]    self        Task Queue オブジェクト.
+ *  @param  [in]        function    登録するタスク関数.
+ *  @return 成功時は, 関数表の番号が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ */
+static int RegisterFunction(struct TaskQueue *self, const struct TaskFunction *function)
+{
+    pthread_spin_lock(&self->registry);
+    int index = FindFunction(self, function);
+    if (index == 0) {
+        size_t num_of_functions = self->num_of_functions;
+        if (num_of_functions < LIMIT_FUNCTIONS) {
+            self->functions[num_of_functions] = *function;
+            atomic_store_explicit(&self->num_of_functions, num_of_functions + 1,
+                                  memory_order_release);
+            index = num_of_functions;
+        } else {
+            index = -1;
+        }
+    }
+    pthread_spin_unlock(&self->registry);
+
+    if (index < 0) {
+        errno = ENOSPC;
+    }
+    return index;
+}
+
+/**
+ *  流量制限クラスのキューからタスクの取り出しを試みる.
+ *
+ *  トークンがない場合は取り出さず, 次にトークンが補充される時刻を通知する.
+ *  保留中のタスクは Worker を占有しない.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in,out]    klass   流量制限クラス.
+ *  @param  [out]       cargo   取り出したタスク.
+ *  @return 取り出せた場合は true が返る.
+ */
+static bool RateClassDequeue(struct TaskQueue *self, struct RateClass *klass,
+                             struct TaskItemCargo *cargo)
+{
+    if (atomic_load(&klass->pending) == 0) {
+        return false;
+    }
+
+    if (!TakeToken(klass, MonotonicNs())) {
+        NoteWakeup(self->pool, atomic_load(&klass->tat) - klass->tolerance_ns);
+        return false;
+    }
+    if (Queue_Dequeue(&klass->que, cargo) != 0) {
+        /* 取り出せなかったトークンは返却する. */
+        atomic_fetch_sub(&klass->tat, klass->interval_ns);
+        return false;
+    }
+    atomic_fetch_sub(&klass->pending, 1);
+
+    return true;
+}
+
+/**
+ *  通常のキューからタスクの取り出しを試みる.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [out]       cargo   取り出したタスク.
+ *  @return 取り出せた場合は true が返る.
+ */
+static inline bool MainDequeue(struct TaskQueue *self, struct TaskItemCargo *cargo)
+{
+    if (Queue_Dequeue(&self->que, cargo) != 0) {
+        return false;
+    }
+    if (self->headroom > 0) {
+        atomic_fetch_sub(&self->backlog, 1);
+    }
+
+    return true;
+}
+
+/**
+ *  期限付きタスクのヒープから, 最も期限の早いタスクの取り出しを試みる.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [out]       cargo   取り出したタスク.
+ *  @return 取り出せた場合は true が返る.
+ */
+static inline bool UrgentDequeue(struct TaskQueue *self, struct TaskItemCargo *cargo)
+{
+    if (atomic_load_explicit(&self->urgent, memory_order_acquire) == 0) {
+        return false;
+    }
+
+    bool found = false;
+    pthread_spin_lock(&self->edf);
+    if (Heap_Pop(&self->heap, NULL, cargo) == 0) {
+        atomic_fetch_sub(&self->urgent, 1);
+        found = true;
+    }
+    pthread_spin_unlock(&self->edf);
+    if (found && (self->headroom > 0)) {
+        atomic_fetch_sub(&self->backlog, 1);
+    }
+
+    return found;
+}
+
+/**
+ *  実行可能なタスクを取り出す.
+ *
+ *  期限付きタスクのヒープにタスクがある場合は, 期限の早いものから優先して取り出す.
+ *  流量制限クラスがある場合は, 各クラスのキューと通常のキューを巡回して
+ *  取り出すため, 制限中のクラスが他のタスクを妨げることはない.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [out]       cargo   取り出したタスク.
+ *  @return 取り出せた場合は true が返る.
+ */
+static bool DequeueReady(struct TaskQueue *self, struct TaskItemCargo *cargo)
+{
+    if (UrgentDequeue(self, cargo)) {
+        return true;
+    }
+
+    size_t num_of_classes = atomic_load_explicit(&self->num_of_classes, memory_order_acquire);
+    if (num_of_classes == 0) {
+        return MainDequeue(self, cargo);
+    }
+
+    size_t start = atomic_fetch_add_explicit(&self->rotation, 1, memory_order_relaxed);
+    for (size_t i = 0; i <= num_of_classes; i += 1) {
+        size_t k = (start + i) % (num_of_classes + 1);
+        if (k == num_of_classes) {
+            if (MainDequeue(self, cargo)) {
+                return true;
+            }
+        } else if (RateClassDequeue(self, self->classes[k], cargo)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ *  タスクを流量制限クラスと実行期限に応じたキューに追加する.
+ *
+ *  ブロッキングタスクは専用のキューに追加する.
+ *  流量制限クラスのタスクは, 実行期限があってもクラスのキューに追加する.
+ *  期限付きタスクのヒープが満杯の場合は通常のキューに追加し, 期限は取り出し時に確認する.
+ *  ヒープのタスクも通常のキューのタスクとして数え, 予備の容量は @c privileged の場合のみ
+ *  使用する.
+ *
+ *  @param  [in,out]    self        Task Queue オブジェクト.
+ *  @param  [in]        cargo       追加するタスク.
+ *  @param  [in]        privileged  予備の容量を使用できるか.
+ *  @return 成功時は, 0 が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ */
+static int PushTask(struct TaskQueue *self, const struct TaskItemCargo *cargo, bool privileged)
+{
+    if ((cargo->flags & CARGO_BLOCKING) != 0) {
+        atomic_fetch_add(&self->blocking_pending, 1);
+        if (Queue_Enqueue(&self->blocking_que, cargo) != 0) {
+            atomic_fetch_sub(&self->blocking_pending, 1);
+            return -1;
+        }
+        return 0;
+    }
+    unsigned int rate_class = cargo->flags & CARGO_RATE_CLASS;
+    if (rate_class == 0) {
+        size_t limit = privileged ? SIZE_MAX : self->admission_limit;
+        if ((self->headroom > 0) && (limit <= atomic_fetch_add(&self->backlog, 1))) {
+            atomic_fetch_sub(&self->backlog, 1);
+            errno = ENOMEM;
+            return -1;
+        }
+        int ret = -1;
+        struct TaskExtension *ext = CargoExtension(self, cargo);
+        if ((ext != NULL) && (ext->deadline != 0) && (self->heap.capacity > 0)) {
+            pthread_spin_lock(&self->edf);
+            ret = Heap_Push(&self->heap, ext->deadline, cargo);
+            if (ret == 0) {
+                atomic_fetch_add(&self->urgent, 1);
+            }
+            pthread_spin_unlock(&self->edf);
+        }
+        if ((ret != 0) && ((ret = Queue_Enqueue(&self->que, cargo)) != 0)
+            && (self->headroom > 0)) {
+            atomic_fetch_sub(&self->backlog, 1);
+        }
+        return ret;
+    }
+
+    struct RateClass *klass = self->classes[rate_class - 1];
+    atomic_fetch_add(&klass->pending, 1);
+    if (Queue_Enqueue(&klass->que, cargo) != 0) {
+        atomic_fetch_sub(&klass->pending, 1);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ *  Task Queue の実行中のタスクか, 未実行の全 Worker 宛てタスクがなくなったことを
+ *  終了処理中の AntTQ_Term() に通知する.
+ *
+ *  Task Queue は通知を受けた AntTQ_Term() が解放し得るため, Worker プールのみを参照する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ */
+static void NotifyDrained(struct TaskPool *self)
+{
+    if (atomic_load(&self->draining) > 0) {
+        lock (&self->drain_mutex) {
+            pthread_cond_broadcast(&self->drained);
+        }
+    }
+}
+
+/**
+ *  キューからタスクの取り出しを試みる.
+ *
+ *  同時実行数の上限に達している場合は取り出さない.
+ *  取り出せた場合は, タスクの処理後に ReleaseTask() を呼び出すこと.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [out]       cargo   取り出したタスク.
+ *  @return 取り出せた場合は true が返る.
+ */
+static bool AcquireTask(struct TaskQueue *self, struct TaskItemCargo *cargo)
+{
+    if (atomic_load(&self->suspended)) {
+        return false;
+    }
+    if (!self->counted) {
+        return DequeueReady(self, cargo);
+    }
+
+    size_t running = atomic_fetch_add(&self->running, 1);
+    if (((self->max_concurrency == 0) || (running < self->max_concurrency))
+        && DequeueReady(self, cargo)) {
+        return true;
+    }
+    struct TaskPool *pool = self->pool;
+    if (atomic_fetch_sub(&self->running, 1) == 1) {
+        NotifyDrained(pool);
+    }
+    return false;
+}
+
+/**
+ *  AcquireTask() で取り出したタスクの処理を終えたことを記録する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ */
+static inline void ReleaseTask(struct TaskQueue *self)
+{
+    if (self->counted) {
+        struct TaskPool *pool = self->pool;
+        if (atomic_fetch_sub(&self->running, 1) == 1) {
+            NotifyDrained(pool);
+        }
+    }
+}
+
+/**
+ *  Deficit Round Robin に従って, 共有している Task Queue からタスクを取り出す.
+ *
+ *  巡回位置の Task Queue に残り実行可能数があれば取り出し, なければ次の
+ *  Task Queue に移って重みの分だけ実行可能数を加える.
+ *  取り出せなかった Task Queue は実行可能数を持ち越さない.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [out]       que     取り出したタスクの Task Queue.
+ *  @param  [out]       cargo   取り出したタスク.
+ *  @return 取り出せた場合は true が返る.
+ */
+static bool PickShared(struct TaskPool *self, struct TaskQueue **que, struct TaskItemCargo *cargo)
+{
+    bool found = false;
+
+    pthread_spin_lock(&self->sched);
+    size_t num_of_queues = self->num_of_queues;
+    for (size_t visits = 0; !found && (visits <= (num_of_queues * 2)) && (0 < num_of_queues); visits += 1) {
+        struct TaskQueue *candidate = self->queues[self->cursor];
+        if ((0 < candidate->deficit) && AcquireTask(candidate, cargo)) {
+            candidate->deficit -= 1;
+            *que = candidate;
+            found = true;
+        } else {
+            candidate->deficit = 0;
+            self->cursor = (self->cursor + 1) % num_of_queues;
+            self->queues[self->cursor]->deficit += self->queues[self->cursor]->weight;
+        }
+    }
+    pthread_spin_unlock(&self->sched);
+
+    return found;
+}
+
+/**
+ *  ローカルバッファから取り出した子タスクを, 実行中のタスクとして数える.
+ *
+ *  @param  [in]    local   取り出した子タスク.
+ *  @param  [out]   que     子タスクの Task Queue.
+ *  @param  [out]   cargo   子タスク.
+ */
+static inline void AdoptLocal(const struct LocalTask *local, struct TaskQueue **que,
+                              struct TaskItemCargo *cargo)
+{
+    /* 親タスクの一部として実行するため, 同時実行数の上限は適用しない. */
+    if (local->que->counted) {
+        atomic_fetch_add(&local->que->running, 1);
+    }
+    *que = local->que;
+    *cargo = local->cargo;
+}
+
+/**
+ *  実行中の Worker のローカルバッファから, 最後に生成された子タスクを取り出す.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [out]       que     取り出したタスクの Task Queue.
+ *  @param  [out]       cargo   取り出したタスク.
+ *  @return 取り出せた場合は true が返る.
+ */
+static bool PopLocal(struct TaskPool *self, struct TaskQueue **que, struct TaskItemCargo *cargo)
+{
+    struct WorkerContext *worker = current_worker;
+    if ((self->local_memory == NULL) || (worker == NULL) || (worker->pool != self)
+        || (LIMIT_WORKERS <= worker->index)) {
+        return false;
+    }
+
+    struct LocalTask local;
+    if (Deque_Pop(&self->locals[worker->index], &local) != 0) {
+        return false;
+    }
+    AdoptLocal(&local, que, cargo);
+
+    return true;
+}
+
+/**
+ *  他の Worker のローカルバッファから, 最も古い子タスクを盗み出す.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [out]       que     取り出したタスクの Task Queue.
+ *  @param  [out]       cargo   取り出したタスク.
+ *  @return 取り出せた場合は true が返る.
+ */
+static bool StealLocal(struct TaskPool *self, struct TaskQueue **que, struct TaskItemCargo *cargo)
+{
+    if (self->local_memory == NULL) {
+        return false;
+    }
+
+    struct WorkerContext *worker = current_worker;
+    size_t start = ((worker != NULL) && (worker->index < self->num_of_workers)) ? worker->index + 1 : 0;
+    for (size_t i = 0; i < self->num_of_workers; i += 1) {
+        struct Deque *victim = &self->locals[(start + i) % self->num_of_workers];
+        struct LocalTask local;
+        int ret;
+        while (((ret = Deque_Steal(victim, &local)) != 0) && (errno == EAGAIN)) {
+            cpu_relax();
+        }
+        if (ret == 0) {
+            AdoptLocal(&local, que, cargo);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ *  Worker プールで実行するタスクを取り出す.
+ *
+ *  実行中の Worker のローカルバッファ, Task Queue, 他の Worker の
+ *  ローカルバッファの順に確認する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [out]       que     取り出したタスクの Task Queue.
+ *  @param  [out]       cargo   取り出したタスク.
+ *  @return 取り出せた場合は true が返る.
+ */
+static inline bool PickTask(struct TaskPool *self, struct TaskQueue **que,
+                            struct TaskItemCargo *cargo)
+{
+    /* 子タスクが生成されたことがなければ, ローカルバッファは確認しない. */
+    bool spawned = atomic_load_explicit(&self->spawned, memory_order_relaxed);
+    if (spawned && PopLocal(self, que, cargo)) {
+        return true;
+    }
+
+    /* 専有されている場合はスケジューリングが不要なため, 直接取り出す. */
+    if (self->exclusive) {
+        *que = self->queues[0];
+        if (AcquireTask(*que, cargo)) {
+            return true;
+        }
+    } else if (PickShared(self, que, cargo)) {
+        return true;
+    }
+
+    return spawned && StealLocal(self, que, cargo);
+}
+
+/**
+ *  実行中の Worker の受信箱に全 Worker 宛てタスクが届いているかを判定する.
+ *
+ *  @return 届いている場合は true が返る.
+ *          Worker 以外のスレッドでは false が返る.
+ */
+static inline bool HasMail(void)
+{
+    struct WorkerContext *worker = current_worker;
+    return (worker != NULL) && (worker->index < LIMIT_WORKERS)
+           && (atomic_load_explicit(&worker->pool->mailboxes[worker->index],
+                                    memory_order_relaxed) != NULL);
+}
+
+/**
+ *  中断中のファイバーを再開できるかを判定する.
+ *
+ *  AntTQ_YieldFiber() で中断したファイバーは, 常に再開できる.
+ *  AntTQ_Await() で中断したファイバーは, 待つタスクが実行を終えるか,
+ *  Task Queue の終了処理が始まった時点で再開できる.
+ *
+ *  @param  [in]    fiber   中断中のファイバー.
+ *  @return 再開できる場合は true が返る.
+ */
+static inline bool IsFiberReady(const struct Fiber *fiber)
+{
+    return (fiber->awaited == NULL)
+           || ((atomic_load(&fiber->awaited->state) >> TICKET_GENERATION_SHIFT) != fiber->generation)
+           || atomic_load(&fiber->frame->que->closing);
+}
+
+/**
+ *  実行中の Worker に再開できる中断中のファイバーがあるかを判定する.
+ *
+ *  @return 再開できるファイバーがある場合は true が返る.
+ *          Worker 以外のスレッドでは false が返る.
+ */
+static inline bool HasReadyFiber(void)
+{
+    struct WorkerContext *worker = current_worker;
+    if (worker == NULL) {
+        return false;
+    }
+    for (const struct Fiber *fiber = worker->parked; fiber != NULL; fiber = fiber->next) {
+        if (IsFiberReady(fiber)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ *  アイドル戦略に従って, 次のタスクを待つ.
+ *
+ *  スピン, CPU の明け渡し, 休止の順に待機し, タスクを取り出せた時点で戻る.
+ *  受信箱に全 Worker 宛てタスクが届いた場合と, 中断中のファイバーが再開できる
+ *  ようになった場合も戻る.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [out]       que     取り出したタスクの Task Queue.
+ *  @param  [out]       cargo   取り出したタスク.
+ *  @return タスクを取り出せた場合は true が返る.
+ */
+static bool WaitForTask(struct TaskPool *self, struct TaskQueue **que, struct TaskItemCargo *cargo)
+{
+    bool found = false;
+
+    uint64_t budget = SpinBudget(self);
+    if (budget > 0) {
+        uint64_t start = MonotonicNs();
+        for (unsigned int i = 1; ; i += 1) {
+            if (PickTask(self, que, cargo)) {
+                return true;
+            }
+            if (HasMail() || HasReadyFiber()) {
+                return false;
+            }
+            cpu_relax();
+            if (((i % SPIN_CHECK_INTERVAL) == 0) && (budget <= (MonotonicNs() - start))) {
+                break;
+            }
+        }
+    }
+
+    unsigned int yields = (self->idle_policy == IP_POWER) ? 0 : self->yields;
+    for (unsigned int i = 0; i < yields; i += 1) {
+        sched_yield();
+        if (PickTask(self, que, cargo)) {
+            return true;
+        }
+        if (HasMail() || HasReadyFiber()) {
+            return false;
+        }
+    }
+
+    lock (&self->mutex) {
+        /* エンキュー側は休止中の Worker がいる場合のみ通知するため,
+         * 休止を宣言してから取り出しを再試行する.
+         * 流量制限で保留中のタスクがある場合は, 実行可能になる時刻に起床する.
+         * 起床時刻は他の休止中の Worker も待っているため, 過ぎた時刻のみ消去する.
+         * 取り出しを再試行すれば, まだ保留中のタスクが次の時刻を通知し直す.
+         */
+        atomic_fetch_add(&self->sleepers, 1);
+        while (true) {
+            uint64_t expired = atomic_load(&self->wakeup_at);
+            if ((expired != 0) && (expired <= MonotonicNs())) {
+                atomic_compare_exchange_strong(&self->wakeup_at, &expired, 0);
+            }
+            if ((found = PickTask(self, que, cargo)) || HasMail() || HasReadyFiber()) {
+                break;
+            }
+            uint64_t wakeup_at = atomic_load(&self->wakeup_at);
+            if (wakeup_at == 0) {
+                pthread_cond_wait(&self->inqueue, &self->mutex);
+            } else {
+                struct timespec abstime = ToTimespec(wakeup_at);
+                pthread_cond_timedwait(&self->inqueue, &self->mutex, &abstime);
+            }
+        }
+        atomic_fetch_sub(&self->sleepers, 1);
+    }
+
+    return found;
+}
+
+/**
+ *  タスクグループを初期化する.
+ *
+ *  @param  [out]   group   タスクグループ.
+ *  @param  [in]    owner   タスクを予約する Task Queue.
+ */
+static void GroupSetup(struct TaskGroup *group, struct TaskQueue *owner)
+{
+    *group = (struct TaskGroup){
+        .owner = owner,
+        .state = 0,
+        .canceled = false,
+    };
+}
+
+/**
+ *  タスクグループの未完了タスクを 1 件減らす.
+ *
+ *  最後のタスクが完了した時点で待機者がいる場合は, 待機者を一度だけ起床させる.
+ *  起床以降は @c group に触れないため, 待機者は戻った直後に @c group を解放できる.
+ *
+ *  @param  [in,out]    group   タスクグループ.
+ */
+static void GroupLeave(struct TaskGroup *group)
+{
+    struct TaskPool *pool = group->owner->pool;
+    uint32_t next, orig = atomic_load(&group->state);
+    do {
+        next = orig - 1;
+        if ((next & GROUP_PENDING) == 0) {
+            next = 0;
+        }
+    } while (!atomic_compare_exchange_weak(&group->state, &orig, next));
+
+    if ((next == 0) && ((orig & GROUP_WAITED) != 0)) {
+        FutexWake(&group->state, INT_MAX);
+    }
+    if ((next == 0) && ((orig & GROUP_HELPED) != 0)) {
+        lock (&pool->mutex) {
+            pthread_cond_broadcast(&pool->helpable);
+        }
+    }
+}
+
+/**
+ *  タスクグループの未完了タスクがなくなるまで待つ.
+ *
+ *  @param  [in,out]    group       タスクグループ.
+ *  @param  [in]        timeout_ms  タイムアウト (ミリ秒). 負数の場合は無期限.
+ *  @return 成功時は, 0 が返る.
+ *          タイムアウト時は, -1 が返り, errno に ETIMEDOUT が設定される.
+ */
+static int GroupWaitFor(struct TaskGroup *group, int timeout_ms)
+{
+    uint64_t deadline = MonotonicNs() + ((uint64_t)timeout_ms * 1000000);
+    uint32_t state = atomic_load(&group->state);
+    while (state != 0) {
+        if ((state & GROUP_WAITED) == 0) {
+            if (!atomic_compare_exchange_weak(&group->state, &state, state | GROUP_WAITED)) {
+                continue;
+            }
+            state |= GROUP_WAITED;
+        }
+
+        struct timespec rel, *timeout = NULL;
+        if (0 <= timeout_ms) {
+            uint64_t now = MonotonicNs();
+            if (deadline <= now) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            rel.tv_sec = (deadline - now) / 1000000000;
+            rel.tv_nsec = (deadline - now) % 1000000000;
+            timeout = &rel;
+        }
+        FutexWait(&group->state, state, timeout);
+        state = atomic_load(&group->state);
+    }
+
+    return 0;
+}
+
+/**
+ *  タスクが取り消されているかを判定する.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    cargo   判定するタスク.
+ *  @return 取り消されている場合は true が返る.
+ */
+static inline bool IsCanceled(struct TaskQueue *self, const struct TaskItemCargo *cargo)
+{
+    if ((atomic_load_explicit(&CargoTicket(self, cargo)->state, memory_order_relaxed)
+         & TICKET_CANCELED) != 0) {
+        return true;
+    }
+
+    struct TaskExtension *ext = CargoExtension(self, cargo);
+    return (ext != NULL)
+           && (((ext->tag != 0)
+                && (ext->generation != atomic_load_explicit(&self->generations[ext->tag],
+                                                            memory_order_relaxed)))
+               || ((ext->group != NULL)
+                   && atomic_load_explicit(&ext->group->canceled, memory_order_relaxed)));
+}
+
+/**
+ *  タスクが実行期限を過ぎているかを判定する.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    cargo   判定するタスク.
+ *  @return 期限を過ぎている場合は true が返る.
+ */
+static inline bool IsExpired(struct TaskQueue *self, const struct TaskItemCargo *cargo)
+{
+    struct TaskExtension *ext = CargoExtension(self, cargo);
+    return (ext != NULL) && (ext->deadline != 0) && (ext->deadline <= MonotonicNs());
+}
+
+/**
+ *  タスク引数スラブから確保した引数を解放する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in]        arg     解放する引数. スラブ外の場合は何もしない.
+ *  @return 解放した場合は true が返る.
+ */
+static bool ReleaseArg(struct TaskQueue *self, void *arg)
+{
+    if ((self->arg_memory == NULL) || (arg == NULL)) {
+        return false;
+    }
+    for (size_t i = 0; i < ARG_SIZE_CLASSES; i += 1) {
+        if (MemoryPool_Contains(&self->args[i], arg)) {
+            MemoryPool_Free(&self->args[i], arg);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ *  タスクの処理を終える.
+ *
+ *  タスクが完了, 失敗, 取り消しのいずれかでキューから離れる際に呼び出す.
+ *  タスク引数スラブから確保した引数とタスクのチケットは, ここで解放する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in]        cargo   処理を終えるタスク.
+ */
+static void FinishTask(struct TaskQueue *self, struct TaskItemCargo *cargo)
+{
+    /* 全 Worker 宛てタスクの引数と付加情報は, 最後の Worker が実行を終えた時に解放する. */
+    bool shared = (cargo->flags & CARGO_SHARED) != 0;
+    if (!shared) {
+        ReleaseArg(self, cargo->arg);
+    }
+
+    struct TaskExtension *ext = CargoExtension(self, cargo);
+    struct TaskGroup *group = (ext != NULL) ? ext->group : NULL;
+    if (!shared) {
+        ReleaseTicket(self, cargo);
+    }
+    if (group != NULL) {
+        GroupLeave(group);
+    }
+}
+
+/**
+ *  タスクの状態変化を通知する.
+ *
+ *  完了リングが購読している状態であれば記録し, コールバックが設定されていれば
+ *  呼び出す. いずれもない状態の通知はコストがかからない.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in]        cargo   状態が変化したタスク.
+ *  @param  [in]        status  タスク状態.
+ *  @param  [in]        result  タスクの結果.
+ *  @return 処理を継続する場合は true が返る.
+ */
+static bool Notify(struct TaskQueue *self, struct TaskItemCargo *cargo,
+                   enum TaskStatus status, intptr_t result)
+{
+    TaskId id = CargoId(self, cargo);
+    if ((self->events & TS_MASK(status)) != 0) {
+        struct TaskCompletion completion = {
+            .id = id,
+            .status = status,
+            .result = result,
+        };
+        bool edge = false;
+        if (Ring_Push(&self->completions, &completion, &edge) != 0) {
+            atomic_fetch_add_explicit(&self->overflow, 1, memory_order_relaxed);
+        } else if (edge) {
+            /* 空から非空になった時のみ通知し, 通知の syscall をまとめる. */
+            eventfd_write(self->completion_fd, 1);
+        }
+    }
+
+    const struct TaskFunction *function = CargoFunction(self, cargo);
+    return (function->Callback == NullCallback)
+           || function->Callback(id, status, cargo->arg);
+}
+
+/* RunTask() は子タスクの完了を待つために, GroupHelpWaitFor() は待つ間に
+ * タスクを実行するために互いを呼び出す.
+ */
+static int GroupHelpWaitFor(struct TaskGroup *group, int timeout_ms);
+
+/**
+ *  取り出したタスクを 1 件処理する.
+ *
+ *  タスクが失敗した場合は, 指定に従いリトライを行う.
+ *  実行期限を過ぎたタスクは実行せずに TS_EXPIRED を通知して破棄する.
+ *  タスクが子タスクを生成した場合は, 子タスクの完了を待ってから状態を通知する.
+ *  @c callback が指定されており, かつ callback が false を返した場合は,
+ *  処理を中断する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in,out]    cargo   処理するタスク.
+ */
+static void RunTask(struct TaskQueue *self, struct TaskItemCargo *cargo)
+{
+    TaskId id = CargoId(self, cargo);
+
+    SealCoalesced(self, cargo);
+    if (IsCanceled(self, cargo)) {
+        FinishTask(self, cargo);
+        return;
+    }
+    if (IsExpired(self, cargo)) {
+        Notify(self, cargo, TS_EXPIRED, 0);
+        FinishTask(self, cargo);
+        return;
+    }
+    if (!Notify(self, cargo, TS_ACK, 0)) {
+        FinishTask(self, cargo);
+        return;
+    }
+
+    /* Watchdog の監視下では, 実行中のタスクを記録する.
+     * 入れ子で実行した場合は, 外側のタスクの記録に戻す.
+     */
+    struct WorkerStamp *stamp = (current_worker != NULL) ? current_worker->stamp : NULL;
+    uint64_t outer_started = 0;
+    TaskId outer_id = 0;
+    if (stamp != NULL) {
+        outer_started = atomic_load_explicit(&stamp->started, memory_order_relaxed);
+        outer_id = atomic_load_explicit(&stamp->id, memory_order_relaxed);
+        atomic_store_explicit(&stamp->id, id, memory_order_relaxed);
+        atomic_store_explicit(&stamp->started, MonotonicNs(), memory_order_release);
+    }
+
+    intptr_t value = 0, *outer = task_result;
+    struct TaskFrame frame = {
+        .que = self,
+        .cargo = cargo,
+        .id = id,
+        .spawned = false,
+        .canceled = false,
+    };
+    struct TaskFrame *outer_frame = current_frame;
+    task_result = &value;
+    current_frame = &frame;
+    bool result = CargoFunction(self, cargo)->Task(id, cargo->arg);
+    /* 子タスクはフレームのグループを参照するため, 戻る前に完了を待つ. */
+    if (frame.spawned) {
+        GroupHelpWaitFor(&frame.children, -1);
+    }
+    current_frame = outer_frame;
+    task_result = outer;
+
+    if (stamp != NULL) {
+        atomic_store_explicit(&stamp->started, outer_started, memory_order_release);
+        atomic_store_explicit(&stamp->id, outer_id, memory_order_relaxed);
+    }
+
+    if (frame.canceled) {
+        Notify(self, cargo, TS_CANCELED, value);
+        FinishTask(self, cargo);
+        return;
+    }
+    struct TaskExtension *ext = CargoExtension(self, cargo);
+    if (!result && (ext != NULL) && (ext->retry > 0)) {
+        if (!Notify(self, cargo, TS_RETRY, value)) {
+            FinishTask(self, cargo);
+            return;
+        }
+        ext->retry -= 1;
+        /* リトライは予備の容量を使用し, 満杯による失敗を避ける. */
+        if (PushTask(self, cargo, true) == 0) {
+            return;
+        }
+    }
+    Notify(self, cargo, (result ? TS_SUCCESS : TS_FAIL), value);
+    FinishTask(self, cargo);
+}
+
+/**
+ *  未使用のファイバーを取得する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @return 取得したファイバーが返る. 未使用のファイバーがない場合は NULL が返る.
+ */
+static struct Fiber *FiberAlloc(struct TaskPool *self)
+{
+    pthread_spin_lock(&self->fiber_lock);
+    struct Fiber *fiber = self->free_fibers;
+    if (fiber != NULL) {
+        self->free_fibers = fiber->next;
+    }
+    pthread_spin_unlock(&self->fiber_lock);
+
+    return fiber;
+}
+
+/**
+ *  ファイバーを未使用のリストに戻す.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [in,out]    fiber   ファイバー.
+ */
+static void FiberFree(struct TaskPool *self, struct Fiber *fiber)
+{
+    pthread_spin_lock(&self->fiber_lock);
+    fiber->next = self->free_fibers;
+    self->free_fibers = fiber;
+    pthread_spin_unlock(&self->fiber_lock);
+}
+
+/**
+ *  ファイバーの開始関数.
+ *
+ *  タスクを実行し終えたら, 再開した Worker に戻る. 以降は再開されない.
+ */
+static void FiberEntry(void)
+{
+    struct Fiber *fiber = current_fiber;
+
+    RunTask(fiber->que, &fiber->cargo);
+    ReleaseTask(fiber->que);
+    fiber->done = true;
+    setcontext(fiber->caller);
+}
+
+/**
+ *  実行中のファイバーを中断し, Worker に戻る.
+ *
+ *  Worker が再開するまで戻らない.
+ *
+ *  @param  [in,out]    fiber   実行中のファイバー.
+ */
+static void ParkFiber(struct Fiber *fiber)
+{
+    swapcontext(&fiber->context, fiber->caller);
+}
+
+/**
+ *  ファイバーを再開し, 中断するか実行し終えるまで待つ.
+ *
+ *  Worker の外側のループからのみ呼び出すため, 戻る時はタスクの状態を
+ *  実行していない状態に戻す. ファイバーの中では Worker を取り消さない.
+ *  中断したファイバーは中断中のリストに, 実行し終えたファイバーは
+ *  未使用のリストに戻す.
+ *
+ *  @param  [in,out]    worker  Worker の状態.
+ *  @param  [in,out]    fiber   再開するファイバー.
+ */
+static void ResumeFiber(struct WorkerContext *worker, struct Fiber *fiber)
+{
+    /* 中断していた時間は実行時間に含めない. */
+    struct WorkerStamp *stamp = worker->stamp;
+    if ((stamp != NULL) && (fiber->frame != NULL)) {
+        atomic_store_explicit(&stamp->id, fiber->frame->id, memory_order_relaxed);
+        atomic_store_explicit(&stamp->started, MonotonicNs(), memory_order_release);
+    }
+
+    ucontext_t caller;
+    int cancel_state;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+    fiber->caller = &caller;
+    current_fiber = fiber;
+    current_frame = fiber->frame;
+    task_result = fiber->result;
+    swapcontext(&caller, &fiber->context);
+    fiber->frame = current_frame;
+    fiber->result = task_result;
+    current_fiber = NULL;
+    current_frame = NULL;
+    task_result = NULL;
+    pthread_setcancelstate(cancel_state, NULL);
+
+    if (stamp != NULL) {
+        atomic_store_explicit(&stamp->started, 0, memory_order_release);
+        atomic_store_explicit(&stamp->id, 0, memory_order_relaxed);
+    }
+
+    if (fiber->done) {
+        FiberFree(worker->pool, fiber);
+    } else {
+        fiber->next = worker->parked;
+        worker->parked = fiber;
+    }
+}
+
+/**
+ *  タスクをファイバーで開始する.
+ *
+ *  @param  [in,out]    worker  Worker の状態.
+ *  @param  [in,out]    que     タスクの Task Queue.
+ *  @param  [in]        cargo   開始するタスク.
+ *  @return 開始した場合は true が返る. 未使用のファイバーがない場合は false が返る.
+ */
+static bool StartFiber(struct WorkerContext *worker, struct TaskQueue *que,
+                       const struct TaskItemCargo *cargo)
+{
+    struct TaskPool *pool = worker->pool;
+    struct Fiber *fiber = FiberAlloc(pool);
+    if (fiber == NULL) {
+        return false;
+    }
+
+    getcontext(&fiber->context);
+    fiber->context.uc_stack.ss_sp = fiber->stack;
+    fiber->context.uc_stack.ss_size = pool->fiber_stack_bytes;
+    fiber->context.uc_link = NULL;
+    makecontext(&fiber->context, FiberEntry, 0);
+    fiber->que = que;
+    fiber->cargo = *cargo;
+    fiber->frame = NULL;
+    fiber->result = NULL;
+    fiber->done = false;
+    ResumeFiber(worker, fiber);
+
+    return true;
+}
+
+/**
+ *  再開できる中断中のファイバーを 1 巡ずつ再開する.
+ *
+ *  再開できないファイバーは, そのまま中断中のリストに戻す.
+ *
+ *  @param  [in,out]    worker  Worker の状態.
+ */
+static void ResumeParked(struct WorkerContext *worker)
+{
+    struct Fiber *fiber = worker->parked;
+    worker->parked = NULL;
+    while (fiber != NULL) {
+        struct Fiber *next = fiber->next;
+        if (IsFiberReady(fiber)) {
+            ResumeFiber(worker, fiber);
+        } else {
+            fiber->next = worker->parked;
+            worker->parked = fiber;
+        }
+        fiber = next;
+    }
+}
+
+/**
+ *  中断中のファイバーのタスクを, 再開せずに破棄する.
+ *
+ *  Worker プールの破棄で Worker が取り消された時に呼び出す.
+ *  タスクには TS_CANCELED を通知し, ファイバーは未使用のリストに戻す.
+ *
+ *  @param  [in,out]    worker  Worker の状態.
+ */
+static void CancelParked(struct WorkerContext *worker)
+{
+    while (worker->parked != NULL) {
+        struct Fiber *fiber = worker->parked;
+        worker->parked = fiber->next;
+        Notify(fiber->que, &fiber->cargo, TS_CANCELED, 0);
+        FinishTask(fiber->que, &fiber->cargo);
+        ReleaseTask(fiber->que);
+        FiberFree(worker->pool, fiber);
+    }
+}
+
+/**
+ *  Worker が取り出したタスクを 1 件処理する.
+ *
+ *  ファイバーで実行するタスクは, 未使用のファイバーがあればファイバーで開始する.
+ *  未使用のファイバーがない場合は, Worker のスタックで実行する.
+ *
+ *  @param  [in,out]    worker  Worker の状態.
+ *  @param  [in,out]    que     タスクの Task Queue.
+ *  @param  [in,out]    cargo   処理するタスク.
+ */
+static void DispatchTask(struct WorkerContext *worker, struct TaskQueue *que,
+                         struct TaskItemCargo *cargo)
+{
+    if (((cargo->flags & CARGO_FIBER) == 0) || !StartFiber(worker, que, cargo)) {
+        RunTask(que, cargo);
+        ReleaseTask(que);
+    }
+}
+
+/**
+ *  全 Worker 宛てタスクの 1 Worker 分の配送を終える.
+ *
+ *  最後の Worker であれば, 全 Worker 宛てタスクを解放する.
+ *
+ *  @param  [in,out]    record  全 Worker 宛てタスク.
+ */
+static void DeliverLetter(struct Broadcast *record)
+{
+    struct TaskQueue *owner = record->owner;
+    struct TaskPool *pool = owner->pool;
+
+    if (atomic_fetch_sub(&record->remaining, 1) == 1) {
+        ReleaseTicket(owner, &record->cargo);
+        ReleaseArg(owner, record->cargo.arg);
+        free(record);
+        atomic_fetch_sub(&owner->broadcasts, 1);
+    }
+    if (atomic_fetch_sub(&owner->letters, 1) == 1) {
+        NotifyDrained(pool);
+    }
+}
+
+/**
+ *  受信箱に届いた全 Worker 宛てタスクを, 届いた順にすべて実行する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [in,out]    worker  実行する Worker の状態.
+ */
+static void OpenMailbox(struct TaskPool *self, struct WorkerContext *worker)
+{
+    if (LIMIT_WORKERS <= worker->index) {
+        return;
+    }
+
+    struct BroadcastLetter *letter = atomic_exchange(&self->mailboxes[worker->index], NULL);
+
+    /* 受信箱は後入れ先出しのため, 反転して届いた順にする. */
+    struct BroadcastLetter *ordered = NULL;
+    while (letter != NULL) {
+        struct BroadcastLetter *next = letter->next;
+        letter->next = ordered;
+        ordered = letter;
+        letter = next;
+    }
+    while (ordered != NULL) {
+        struct BroadcastLetter *next = ordered->next;
+        struct Broadcast *record = ordered->record;
+        struct TaskItemCargo cargo = record->cargo;
+        RunTask(record->owner, &cargo);
+        DeliverLetter(record);
+        ordered = next;
+    }
+}
+
+/**
+ *  キューのタスクを実行しながら, タスクグループの未完了タスクがなくなるまで待つ.
+ *
+ *  待機中の呼び出し元スレッドは Worker と同じ経路でタスクを実行するため,
+ *  Worker がすべて塞がっていても, 待ち合わせているタスクの実行が進む.
+ *  呼び出し元が Worker の場合は, 自身宛ての全 Worker 宛てタスクも実行する.
+ *  実行できるタスクがない間は, Worker と同じ条件変数で休止する.
+ *
+ *  @param  [in,out]    group       タスクグループ.
+ *  @param  [in]        timeout_ms  タイムアウト (ミリ秒). 負数の場合は無期限.
+ *  @return 成功時は, 0 が返る.
+ *          タイムアウト時は, -1 が返り, errno に ETIMEDOUT が設定される.
+ */
+static int GroupHelpWaitFor(struct TaskGroup *group, int timeout_ms)
+{
+    struct TaskQueue *owner = group->owner;
+    struct TaskPool *pool = owner->pool;
+    uint64_t deadline = MonotonicNs() + ((uint64_t)timeout_ms * 1000000);
+    struct timespec abstime = ToTimespec(deadline);
+
+    uint32_t state = atomic_load(&group->state);
+    while (state != 0) {
+        if ((state & GROUP_HELPED) == 0) {
+            if (!atomic_compare_exchange_weak(&group->state, &state, state | GROUP_HELPED)) {
+                continue;
+            }
+        }
+
+        /* Worker が待つ場合は, 全 Worker 宛てタスクも受け取る. */
+        if (current_worker != NULL) {
+            OpenMailbox(current_worker->pool, current_worker);
+        }
+
+        /* 呼び出し元が Worker の場合は, 自身が生成した子タスクを優先する. */
+        struct TaskQueue *que = owner;
+        struct TaskItemCargo cargo;
+        bool found = PopLocal(pool, &que, &cargo) || AcquireTask(owner, &cargo);
+        if (!found) {
+            que = owner;
+            if ((0 <= timeout_ms) && (deadline <= MonotonicNs())) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            /* 待機者は自身の Task Queue のタスクしか実行できないため, Worker とは
+             * 別の条件変数で休止し, Worker 宛ての起床を横取りしない.
+             */
+            lock (&pool->mutex) {
+                atomic_fetch_add(&pool->helpers, 1);
+                while ((atomic_load(&group->state) != 0) && !(found = AcquireTask(owner, &cargo))
+                       && !HasMail()) {
+                    if (timeout_ms < 0) {
+                        pthread_cond_wait(&pool->helpable, &pool->mutex);
+                    } else if (pthread_cond_timedwait(&pool->helpable, &pool->mutex, &abstime) != 0) {
+                        break;
+                    }
+                }
+                atomic_fetch_sub(&pool->helpers, 1);
+            }
+        }
+        if (found) {
+            RunTask(que, &cargo);
+            ReleaseTask(que);
+        }
+        state = atomic_load(&group->state);
+    }
+
+    return 0;
+}
+
+/**
+ *  Worker の終了時に, Worker ごとの資源を解放する.
+ *
+ *  @param  [in,out]    arg Worker の状態.
+ */
+static void WorkerCleanup(void *arg)
+{
+    struct WorkerContext *worker = (struct WorkerContext *)arg;
+    struct TaskPool *pool = worker->pool;
+
+    CancelParked(worker);
+    if (pool->WorkerFini != NULL) {
+        pool->WorkerFini(worker->local, pool->worker_ctx);
+    }
+    free(worker->scratch);
+    current_worker = NULL;
+}
+
+/**
+ *  タスク実行ワーカー.
+ *
+ *  Worker プールが共有する Task Queue からタスクを取り出し, 実行する.
+ *  作業領域はタスクを 1 件実行するごとに解放する.
+ *  受信箱はタスクの合間に確認し, 届いた全 Worker 宛てタスクを実行する.
+ *  中断中のファイバーもタスクの合間に再開する.
+ *
+ *  @param  [in]    arg Worker プール.
+ *  @pre    @c arg の非 NULL は呼び出し側で保証すること.
+ */
+static void *Worker(void *arg)
+{
+    struct TaskPool *pool = (struct TaskPool *)arg;
+    struct WorkerContext worker = {
+        .pool = pool,
+        .index = atomic_fetch_add(&pool->num_of_started, 1),
+        .local = NULL,
+        .scratch = (pool->scratch_bytes > 0) ? malloc(pool->scratch_bytes) : NULL,
+        .used = 0,
+        .stamp = NULL,
+        .parked = NULL,
+    };
+    if (pool->watchdog_ns > 0) {
+        worker.stamp = &pool->stamps[worker.index];
+    }
+    if (pool->WorkerInit != NULL) {
+        worker.local = pool->WorkerInit(pool->worker_ctx);
+    }
+    current_worker = &worker;
+
+    pthread_cleanup_push(WorkerCleanup, &worker);
+    while (true) {
+        pthread_testcancel();
+
+        OpenMailbox(pool, &worker);
+        worker.used = 0;
+
+        struct TaskQueue *que;
+        struct TaskItemCargo cargo;
+        /* 再開できるファイバーがある間は休止せず, タスクの合間に再開する.
+         * 完了を待つファイバーしかない場合は休止し, 待つタスクの完了で起床する.
+         */
+        if (HasReadyFiber()) {
+            if (!PickTask(pool, &que, &cargo)) {
+                ResumeParked(&worker);
+                sched_yield();
+                continue;
+            }
+        } else if (!WaitForTask(pool, &que, &cargo)) {
+            ResumeParked(&worker);
+            continue;
+        }
+
+        do {
+            DispatchTask(&worker, que, &cargo);
+            ResumeParked(&worker);
+            OpenMailbox(pool, &worker);
+            worker.used = 0;
+        } while (PickTask(pool, &que, &cargo));
+    }
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+/**
+ *  代替 Worker の終了を記録する.
+ *
+ *  自ら終了を決めていない場合 (取り消された場合) は, 代替 Worker の数を減らす.
+ *
+ *  @param  [in,out]    arg 代替 Worker の管理構造体.
+ */
+static void SpareRetire(void *arg)
+{
+    struct SpareSlot *slot = (struct SpareSlot *)arg;
+    struct TaskPool *pool = slot->pool;
+
+    lock (&pool->watchdog_mutex) {
+        if (slot->state == SS_RUNNING) {
+            pool->spares -= 1;
+        }
+        slot->state = SS_EXITED;
+    }
+}
+
+/**
+ *  代替 Worker.
+ *
+ *  実行時間の上限を超えたタスクが Worker を塞いでいる間, Worker の代わりに
+ *  タスクを実行する. 塞がれている Worker の数が代替 Worker の数を下回り,
+ *  実行できるタスクがなくなれば終了する.
+ *
+ *  @param  [in]    arg 代替 Worker の管理構造体.
+ *  @pre    @c arg の非 NULL は呼び出し側で保証すること.
+ */
+static void *SpareWorker(void *arg)
+{
+    struct SpareSlot *slot = (struct SpareSlot *)arg;
+    struct TaskPool *pool = slot->pool;
+    struct WorkerContext worker = {
+        .pool = pool,
+        .index = LIMIT_WORKERS,
+        .local = NULL,
+        .scratch = (pool->scratch_bytes > 0) ? malloc(pool->scratch_bytes) : NULL,
+        .used = 0,
+        .stamp = NULL,
+        .parked = NULL,
+    };
+    if (pool->WorkerInit != NULL) {
+        worker.local = pool->WorkerInit(pool->worker_ctx);
+    }
+    current_worker = &worker;
+
+    bool alive = true;
+    pthread_cleanup_push(SpareRetire, slot);
+    pthread_cleanup_push(WorkerCleanup, &worker);
+    while (alive) {
+        struct TaskQueue *que;
+        struct TaskItemCargo cargo;
+        if (PickTask(pool, &que, &cargo)) {
+            RunTask(que, &cargo);
+            ReleaseTask(que);
+            worker.used = 0;
+            continue;
+        }
+
+        lock (&pool->mutex) {
+            struct timespec abstime = ToTimespec(MonotonicNs() + pool->watchdog_ns / WATCHDOG_DIVISOR);
+            atomic_fetch_add(&pool->sleepers, 1);
+            pthread_cond_timedwait(&pool->inqueue, &pool->mutex, &abstime);
+            atomic_fetch_sub(&pool->sleepers, 1);
+        }
+        lock (&pool->watchdog_mutex) {
+            if (pool->closing || (atomic_load(&pool->stuck) < pool->spares)) {
+                pool->spares -= 1;
+                slot->state = SS_LEAVING;
+                alive = false;
+            }
+        }
+    }
+    pthread_cleanup_pop(1);
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+/**
+ *  塞がれている Worker の数まで代替 Worker を起動する.
+ *
+ *  終了した代替 Worker は, ここで join する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [in]        stuck   塞がれている Worker の数.
+ *  @pre    watchdog_mutex を取得していること.
+ */
+static void SpawnSpares(struct TaskPool *self, size_t stuck)
+{
+    for (size_t i = 0; i < self->spare_limit; i += 1) {
+        struct SpareSlot *slot = &self->spare_slots[i];
+        if (slot->state == SS_EXITED) {
+            pthread_join(slot->thrd_id, NULL);
+            slot->state = SS_FREE;
+        }
+        if ((slot->state == SS_FREE) && (self->spares < stuck) && !self->closing) {
+            slot->state = SS_RUNNING;
+            if (pthread_create(&slot->thrd_id, NULL, SpareWorker, slot) == 0) {
+                self->spares += 1;
+            } else {
+                slot->state = SS_FREE;
+            }
+        }
+    }
+}
+
+/**
+ *  タスクの実行時間を監視する Watchdog.
+ *
+ *  実行時間の上限の 1/WATCHDOG_DIVISOR ごとに各 Worker の記録を確認し,
+ *  上限を超えたタスクを 1 件につき 1 度だけ報告する.
+ *  代替 Worker が許可されている場合は, 塞がれている Worker の数まで起動する.
+ *
+ *  @param  [in]    arg Worker プール.
+ *  @pre    @c arg の非 NULL は呼び出し側で保証すること.
+ */
+static void *Watchdog(void *arg)
+{
+    struct TaskPool *self = (struct TaskPool *)arg;
+    bool alive = true;
+
+    while (alive) {
+        uint64_t now = MonotonicNs();
+        size_t stuck = 0;
+        for (size_t i = 0; i < self->num_of_workers; i += 1) {
+            struct WorkerStamp *stamp = &self->stamps[i];
+            uint64_t started = atomic_load_explicit(&stamp->started, memory_order_acquire);
+            TaskId id = atomic_load_explicit(&stamp->id, memory_order_relaxed);
+            if ((started == 0) || ((now - started) < self->watchdog_ns)
+                || (started != atomic_load_explicit(&stamp->started, memory_order_acquire))) {
+                continue;
+            }
+            stuck += 1;
+            if ((stamp->reported != started) && (self->TaskStuck != NULL)) {
+                self->TaskStuck(id, (now - started) / 1000000, self->watchdog_ctx);
+            }
+            stamp->reported = started;
+        }
+        atomic_store(&self->stuck, stuck);
+
+        lock (&self->watchdog_mutex) {
+            size_t wanted = (stuck < self->spare_limit) ? stuck : self->spare_limit;
+            SpawnSpares(self, wanted);
+            if (!self->closing) {
+                struct timespec abstime = ToTimespec(MonotonicNs() + self->watchdog_ns / WATCHDOG_DIVISOR);
+                pthread_cond_timedwait(&self->watchdog_cond, &self->watchdog_mutex, &abstime);
+            }
+            alive = !self->closing;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ *  Watchdog と代替 Worker をすべて終了させる.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ */
+static void StopWatchdog(struct TaskPool *self)
+{
+    if (self->watchdog_ns == 0) {
+        return;
+    }
+
+    lock (&self->watchdog_mutex) {
+        self->closing = true;
+        pthread_cond_broadcast(&self->watchdog_cond);
+    }
+    pthread_join(self->watchdog, NULL);
+
+    lock (&self->watchdog_mutex) {
+        for (size_t i = 0; i < self->spare_limit; i += 1) {
+            if (self->spare_slots[i].state == SS_RUNNING) {
+                pthread_cancel(self->spare_slots[i].thrd_id);
+            }
+        }
+    }
+    for (size_t i = 0; i < self->spare_limit; i += 1) {
+        if (self->spare_slots[i].state != SS_FREE) {
+            pthread_join(self->spare_slots[i].thrd_id, NULL);
+            self->spare_slots[i].state = SS_FREE;
+        }
+    }
+}
+
+/**
+ *  ブロッキングタスク用スレッド.
+ *
+ *  ブロッキングタスクのキューからタスクを取り出し, 実行する.
+ *  一定時間タスクが到着しなければ終了する.
+ *
+ *  @param  [in]    arg Task Queue オブジェクト.
+ *  @pre    @c arg の非 NULL は呼び出し側で保証すること.
+ */
+static void *BlockingWorker(void *arg)
+{
+    struct TaskQueue *self = (struct TaskQueue *)arg;
+    bool alive = true;
+
+    while (alive) {
+        struct TaskItemCargo cargo;
+        if (!atomic_load(&self->closing) && !atomic_load(&self->suspended)
+            && (Queue_Dequeue(&self->blocking_que, &cargo) == 0)) {
+            atomic_fetch_sub(&self->blocking_pending, 1);
+            RunTask(self, &cargo);
+            continue;
+        }
+
+        lock (&self->blocking_mutex) {
+            struct timespec abstime = ToTimespec(MonotonicNs() + BLOCKING_KEEPALIVE_NS);
+            int ret = 0;
+            self->blocking_idle += 1;
+            while ((ret == 0) && !self->closing
+                   && (atomic_load(&self->suspended) || (atomic_load(&self->blocking_pending) == 0))) {
+                ret = pthread_cond_timedwait(&self->blocking_cond, &self->blocking_mutex, &abstime);
+            }
+            self->blocking_idle -= 1;
+            if (self->closing || ((ret != 0) && (atomic_load(&self->blocking_pending) == 0))) {
+                /* 破棄を待つスレッドのため, 最後に状態を更新して通知する. */
+                self->blocking_threads -= 1;
+                pthread_cond_broadcast(&self->blocking_cond);
+                alive = false;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ *  ブロッキングタスクの到着を通知する.
+ *
+ *  待機中のスレッドがいなければ, 上限までスレッドを追加する.
+ *  スレッドを追加できない場合でも, 既存のスレッドが順に実行する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ */
+static void WakeBlocking(struct TaskQueue *self)
+{
+    lock (&self->blocking_mutex) {
+        if (self->blocking_idle > 0) {
+            pthread_cond_signal(&self->blocking_cond);
+        } else if (self->blocking_threads < self->blocking_limit) {
+            pthread_attr_t thrd_attr;
+            pthread_t thrd_id;
+            pthread_attr_init(&thrd_attr);
+            pthread_attr_setdetachstate(&thrd_attr, PTHREAD_CREATE_DETACHED);
+            if (pthread_create(&thrd_id, &thrd_attr, BlockingWorker, self) == 0) {
+                self->blocking_threads += 1;
+            }
+            pthread_attr_destroy(&thrd_attr);
+        }
+    }
+}
+
+/**
+ *  ブロッキングタスク用スレッドをすべて終了させる.
+ *
+ *  実行中のブロッキングタスクがある場合は, その完了を待つ.
+ *  実行されなかったブロッキングタスクには TS_CANCELED を通知して破棄する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ */
+static void StopBlocking(struct TaskQueue *self)
+{
+    lock (&self->blocking_mutex) {
+        atomic_store(&self->closing, true);
+        pthread_cond_broadcast(&self->blocking_cond);
+        while (self->blocking_threads > 0) {
+            pthread_cond_wait(&self->blocking_cond, &self->blocking_mutex);
+        }
+    }
+
+    struct TaskItemCargo cargo;
+    while ((self->blocking_limit > 0) && (Queue_Dequeue(&self->blocking_que, &cargo) == 0)) {
+        Notify(self, &cargo, TS_CANCELED, 0);
+        FinishTask(self, &cargo);
+    }
+}
+
+/**
+ *  タスクの追加先のキューから, 最も古い未実行のタスクを破棄する.
+ *
+ *  破棄したタスクには, 呼び出し元のスレッドで TS_DROPPED を通知する.
+ *  期限付きタスクのヒープは古い順に取り出せないため, 通常のキューが空の場合のみ
+ *  最も期限の早いタスクを破棄する. ブロッキングタスクのキューは対象外とする.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in]        cargo   追加しようとしているタスク.
+ *  @return 破棄した場合は true が返る.
+ */
+static bool DropOldest(struct TaskQueue *self, const struct TaskItemCargo *cargo)
+{
+    if ((cargo->flags & CARGO_BLOCKING) != 0) {
+        return false;
+    }
+
+    struct TaskItemCargo victim;
+    unsigned int rate_class = cargo->flags & CARGO_RATE_CLASS;
+    if (rate_class == 0) {
+        if (!MainDequeue(self, &victim) && !UrgentDequeue(self, &victim)) {
+            return false;
+        }
+    } else {
+        struct RateClass *klass = self->classes[rate_class - 1];
+        if (Queue_Dequeue(&klass->que, &victim) != 0) {
+            return false;
+        }
+        atomic_fetch_sub(&klass->pending, 1);
+    }
+
+    SealCoalesced(self, &victim);
+    if (!IsCanceled(self, &victim)) {
+        Notify(self, &victim, TS_DROPPED, 0);
+    }
+    FinishTask(self, &victim);
+
+    return true;
+}
+
+/**
+ *  運搬情報を作成したタスクをキューに追加し, Worker に通知する.
+ *
+ *  キューが満杯の場合は, 受け入れ方針に従う.
+ *
+ *  @param  [in,out]    self        Task Queue オブジェクト.
+ *  @param  [in]        cargo       追加するタスク.
+ *  @param  [in,out]    group       所属するタスクグループ. 所属しない場合は NULL.
+ *  @param  [in]        admission   キューが満杯の時の受け入れ方針.
+ *  @return 成功時は, 予約したタスクの識別子が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ *          失敗時は, タスクのチケットと付加情報は解放されている.
+ */
+static TaskId SubmitCargo(struct TaskQueue *self, const struct TaskItemCargo *cargo,
+                          struct TaskGroup *group, enum AdmissionPolicy admission)
+{
+    /* 予約したタスクはすぐに実行を終えて識別子が無効になり得るため, 先に求める. */
+    TaskId id = CargoId(self, cargo);
+    if (group != NULL) {
+        atomic_fetch_add(&group->state, 1);
+    }
+    RecordArrival(self->pool);
+    bool privileged = (cargo->flags & CARGO_PRIORITY) != 0;
+    int ret;
+    while (((ret = PushTask(self, cargo, privileged)) != 0) && (errno == ENOMEM)
+           && (admission == AP_DROP_OLDEST) && DropOldest(self, cargo)) {
+        /* 空けた領域を他の予約者に取られた場合は, 再度破棄する. */
+    }
+    if ((ret != 0) && (errno == ENOMEM) && (admission == AP_CALLER_RUNS)) {
+        struct TaskItemCargo inline_cargo = *cargo;
+        RunTask(self, &inline_cargo);
+        return id;
+    }
+    if (ret != 0) {
+        int err = errno;
+        ReleaseTicket(self, cargo);
+        if (group != NULL) {
+            GroupLeave(group);
+        }
+        errno = err;
+        return -1;
+    }
+    if ((cargo->flags & CARGO_BLOCKING) != 0) {
+        WakeBlocking(self);
+        return id;
+    }
+    /* スピン中の Worker は自ら取り出すため, 休止中の Worker がいる場合のみ起こす.
+     * 待機者はどの Task Queue のタスクを待っているか分からないため, すべて起こす.
+     */
+    if ((atomic_load(&self->pool->sleepers) > 0) || (atomic_load(&self->pool->helpers) > 0)) {
+        lock (&self->pool->mutex) {
+            pthread_cond_signal(&self->pool->inqueue);
+            if (atomic_load(&self->pool->helpers) > 0) {
+                pthread_cond_broadcast(&self->pool->helpable);
+            }
+        }
+    }
+
+    /* ワーカーのスループットを良くするため, CPU を明け渡す. */
+    if (self->pool->num_of_workers > 0) {
+        sched_yield();
+    }
+
+    return id;
+}
+
+/**
+ *  予約するタスク情報から, 運搬情報のフラグを求める.
+ *
+ *  @param  [in]    item    予約するタスク情報.
+ *  @return 運搬情報のフラグが返る.
+ */
+static inline uint8_t ItemFlags(const struct TaskItem *item)
+{
+    return item->rate_class | (item->blocking ? CARGO_BLOCKING : 0)
+           | (item->priority ? CARGO_PRIORITY : 0) | (item->fiber ? CARGO_FIBER : 0);
+}
+
+/**
+ *  チケットか付加情報の領域が枯渇した時に, 受け入れ方針に従って領域を空ける.
+ *
+ *  キューが満杯の場合と同じく, AP_DROP_OLDEST では追加先のキューの最も古いタスクを
+ *  破棄し, AP_CALLER_RUNS では未実行のタスクを 1 件, 呼び出し元のスレッドで実行する.
+ *  予約しようとしているタスクはチケットを持たないため, 代わりに実行することはできない.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in]        flags   予約しようとしているタスクの運搬情報のフラグ.
+ *  @return 領域を空けた場合は true が返る.
+ *          空けられない場合は false が返り, errno に ENOMEM が設定される.
+ */
+static bool MakeRoom(struct TaskQueue *self, uint8_t flags)
+{
+    struct TaskItemCargo cargo = {.flags = flags};
+    if ((self->admission == AP_DROP_OLDEST) && DropOldest(self, &cargo)) {
+        return true;
+    }
+    if ((self->admission == AP_CALLER_RUNS) && AcquireTask(self, &cargo)) {
+        RunTask(self, &cargo);
+        ReleaseTask(self);
+        return true;
+    }
+
+    errno = ENOMEM;
+    return false;
+}
+
+/**
+ *  予約するタスクの運搬情報を作成する.
+ *
+ *  タスク関数は関数表に自動で登録し, 既定値以外の属性を持つ場合のみ
+ *  付加情報を確保する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in,out]    item    予約するタスク情報.
+ *  @param  [in,out]    group   所属するタスクグループ. 所属しない場合は NULL.
+ *  @param  [out]       cargo   作成した運搬情報.
+ *  @return 成功時は, 0 が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ *  @pre    引数の妥当性は呼び出し側で保証する.
+ */
+static int PrepareCargo(struct TaskQueue *self, struct TaskItem *item, struct TaskGroup *group,
+                        struct TaskItemCargo *cargo)
+{
+    if ((item->rate_class < 0)
+        || (atomic_load(&self->num_of_classes) < (size_t)item->rate_class)
+        || (LIMIT_TAGS <= item->tag)
+        || (CP_LENGTH <= (unsigned int)item->coalesce)
+        || ((item->coalesce == CP_MERGE) && (item->Merge == NULL))
+        || (item->blocking && (self->blocking_limit == 0))
+        || (item->fiber && (self->pool->fiber_limit == 0))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* ワーカーの処理をシンプルにするため, コールバックが設定されていない場合は
+     * ダミーのコールバックを設定する.
+     */
+    if (item->Callback == NULL) {
+        item->Callback = NullCallback;
+    }
+
+    struct TaskFunction function = {
+        .Task = item->Task,
+        .Callback = item->Callback,
+    };
+    int index = FindFunction(self, &function);
+    if (index == 0) {
+        index = RegisterFunction(self, &function);
+    }
+    /* 合流はグループに属さないタスクのみを対象とする. */
+    uint32_t key = ((self->coalesce != NULL) && (group == NULL)) ? item->coalesce_key : 0;
+    struct TaskExtension *ext = NULL;
+    uint32_t extension = 0;
+    if ((index <= 0) || (group != NULL) || (item->deadline_ms != 0) || (item->tag != 0)
+        || (item->retry > 0) || (key != 0)) {
+        ext = AllocExtension(self, item->rate_class, &extension);
+        if (ext == NULL) {
+            return -1;
+        }
+        *ext = (struct TaskExtension){
+            .function = function,
+            .group = group,
+            .deadline = (item->deadline_ms == 0)
+                        ? 0 : MonotonicNs() + ((uint64_t)item->deadline_ms * 1000000),
+            .generation = atomic_load_explicit(&self->generations[item->tag], memory_order_relaxed),
+            .tag = item->tag,
+            .retry = item->retry,
+            .key = key,
+            .merge = MERGE_OPEN,
+            .id = -1,
+            .arg = item->arg,
+        };
+    }
+    uint32_t ticket;
+    if (IssueTicket(self, item->rate_class, extension, &ticket) != 0) {
+        FreeExtension(self, extension);
+        return -1;
+    }
+
+    *cargo = (struct TaskItemCargo){
+        .ticket = ticket,
+        .function = (index < 0) ? 0 : index,
+        .flags = ItemFlags(item),
+        .arg = item->arg,
+    };
+    if (ext != NULL) {
+        ext->id = CargoId(self, cargo);
+    }
+
+    return 0;
+}
+
+/**
+ *  同じ合流キーの未実行のタスクに合流する.
+ *
+ *  合流したタスクの引数は, 新しいタスクの合流方針に従って更新する.
+ *  タスク関数とコールバックは, 未実行のタスクのものを使用する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in]        item    予約するタスク情報.
+ *  @return 合流した場合は, 未実行のタスクの識別子が返る.
+ *          合流できるタスクがない場合は, -1 が返る.
+ */
+static TaskId MergePending(struct TaskQueue *self, struct TaskItem *item)
+{
+    if ((CP_LENGTH <= (unsigned int)item->coalesce)
+        || ((item->coalesce == CP_MERGE) && (item->Merge == NULL))) {
+        return -1;
+    }
+
+    uint32_t key = item->coalesce_key;
+    _Atomic(uint64_t) *slot = CoalesceSlot(self, key);
+    uint64_t entry = atomic_load(slot);
+    if ((uint32_t)(entry >> 32) != key) {
+        return -1;
+    }
+    struct TaskExtension *ext = ExtensionAt(self, (uint32_t)entry);
+    uint32_t state = MERGE_OPEN;
+    while (!atomic_compare_exchange_weak(&ext->merge, &state, MERGE_BUSY)) {
+        if (state == MERGE_SEALED) {
+            return -1;
+        }
+        state = MERGE_OPEN;
+        cpu_relax();
+    }
+
+    /* 合流先のタスクが実行を終えて付加情報が再利用された可能性があるため,
+     * 表と, 付加情報を保持するタスクの世代を確認しなおす.
+     * 合流中は締め切られないため, 確認後にタスクが実行を始めることはない.
+     */
+    TaskId id = ext->id;
+    bool live = false;
+    if ((id >= 0) && (ext->key == key) && (atomic_load(slot) == entry)) {
+        struct TaskTicket *ticket = FindTicket(self, id);
+        live = ((atomic_load_explicit(&ticket->state, memory_order_acquire)
+                 >> TICKET_GENERATION_SHIFT) == IdGeneration(self, id))
+               && (ticket->extension == (uint32_t)entry);
+    }
+    if (!live) {
+        id = -1;
+    } else {
+        switch (item->coalesce) {
+        case CP_KEEP_FIRST:
+            ReleaseArg(self, item->arg);
+            break;
+        case CP_KEEP_LAST:
+            ReleaseArg(self, ext->arg);
+            ext->arg = item->arg;
+            break;
+        default:
+            ext->arg = item->Merge(ext->arg, item->arg);
+            break;
+        }
+    }
+    atomic_store(&ext->merge, MERGE_OPEN);
+
+    return id;
+}
+
+/**
+ *  予約したタスクを合流先として合流キーの表に登録する.
+ *
+ *  表の要素が実行を開始していない別のタスクで使用中の場合は, 登録しない.
+ *
+ *  @param  [in,out]    self        Task Queue オブジェクト.
+ *  @param  [in]        key         合流キー.
+ *  @param  [in]        extension   予約したタスクの付加情報の番号 + 1.
+ */
+static void PublishPending(struct TaskQueue *self, uint32_t key, uint32_t extension)
+{
+    _Atomic(uint64_t) *slot = CoalesceSlot(self, key);
+    uint64_t entry = atomic_load(slot);
+    do {
+        if (entry != 0) {
+            struct TaskExtension *ext = ExtensionAt(self, (uint32_t)entry);
+            if ((ext->key == (uint32_t)(entry >> 32))
+                && (atomic_load(&ext->merge) != MERGE_SEALED)) {
+                return;
+            }
+        }
+    } while (!atomic_compare_exchange_weak(slot, &entry, CoalesceEntry(key, extension)));
+}
+
+/**
+ *  タスクを予約する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in,out]    item    予約するタスク情報.
+ *  @param  [in,out]    group   所属するタスクグループ. 所属しない場合は NULL.
+ *  @return 成功時は, 予約したタスクの識別子が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ *  @pre    引数の妥当性は呼び出し側で保証する.
+ */
+static TaskId EnqueueItem(struct TaskQueue *self, struct TaskItem *item, struct TaskGroup *group)
+{
+    bool coalescing = (self->coalesce != NULL) && (group == NULL) && (item->coalesce_key != 0);
+    if (coalescing) {
+        TaskId id = MergePending(self, item);
+        if (id >= 0) {
+            return id;
+        }
+    }
+
+    struct TaskItemCargo cargo;
+    while (PrepareCargo(self, item, group, &cargo) != 0) {
+        if ((errno != ENOMEM) || !MakeRoom(self, ItemFlags(item))) {
+            return -1;
+        }
+    }
+    /* 予約後はチケットが解放され得るため, 付加情報の番号を先に控える. */
+    uint32_t extension = CargoTicket(self, &cargo)->extension;
+    TaskId id = SubmitCargo(self, &cargo, group, self->admission);
+    if (coalescing && (id >= 0)) {
+        PublishPending(self, item->coalesce_key, extension);
+    }
+
+    return id;
+}
+
+/**
+ *  実行中のタスクの子タスクを予約する.
+ *
+ *  Worker で実行中の場合は, Worker のローカルバッファに追加する.
+ *  ローカルバッファが満杯の場合や, 流量制限クラスとブロッキングタスクは,
+ *  通常どおり Task Queue に予約する.
+ *
+ *  @param  [in,out]    frame   実行中のタスクの状態.
+ *  @param  [in,out]    item    予約するタスク情報.
+ *  @return 成功時は, 予約したタスクの識別子が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ */
+static TaskId SpawnItem(struct TaskFrame *frame, struct TaskItem *item)
+{
+    struct TaskQueue *self = frame->que;
+    struct TaskPool *pool = self->pool;
+    struct TaskGroup *group = &frame->children;
+
+    if (!frame->spawned) {
+        GroupSetup(group, self);
+        frame->spawned = true;
+    }
+    struct TaskItemCargo cargo;
+    while (PrepareCargo(self, item, group, &cargo) != 0) {
+        if ((errno != ENOMEM) || !MakeRoom(self, ItemFlags(item))) {
+            return -1;
+        }
+    }
+
+    struct WorkerContext *worker = current_worker;
+    if ((pool->local_memory == NULL) || (worker == NULL) || (worker->pool != pool)
+        || (LIMIT_WORKERS <= worker->index) || ((cargo.flags & (CARGO_RATE_CLASS | CARGO_BLOCKING)) != 0)) {
+        return SubmitCargo(self, &cargo, group, self->admission);
+    }
+
+    TaskId id = CargoId(self, &cargo);
+    atomic_fetch_add(&group->state, 1);
+    struct LocalTask local = {
+        .que = self,
+        .cargo = cargo,
+    };
+    if (Deque_Push(&pool->locals[worker->index], &local) != 0) {
+        GroupLeave(group);
+        return SubmitCargo(self, &cargo, group, self->admission);
+    }
+    if (!atomic_load_explicit(&pool->spawned, memory_order_relaxed)) {
+        atomic_store(&pool->spawned, true);
+    }
+    /* 休止中の Worker がいれば, 盗み出せるように起こす. */
+    if (atomic_load(&pool->sleepers) > 0) {
+        lock (&pool->mutex) {
+            pthread_cond_signal(&pool->inqueue);
+        }
+    }
+
+    return id;
+}
+
+/**
+ *  タスクを Worker プールのすべての Worker に配送する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in,out]    item    配送するタスク情報.
+ *  @param  [in,out]    group   所属するタスクグループ. 所属しない場合は NULL.
+ *  @return 成功時は, 配送したタスクの識別子が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ *  @pre    引数の妥当性は呼び出し側で保証する.
+ */
+static TaskId BroadcastItem(struct TaskQueue *self, struct TaskItem *item, struct TaskGroup *group)
+{
+    if ((item->retry != 0) || (item->rate_class != 0) || item->blocking || item->fiber
+        || (item->coalesce_key != 0) || (self->pool->num_of_workers == 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct TaskFunction function = {
+        .Task = item->Task,
+        .Callback = (item->Callback == NULL) ? NullCallback : item->Callback,
+    };
+    int index = FindFunction(self, &function);
+    if (index == 0) {
+        index = RegisterFunction(self, &function);
+    }
+
+    /* チケットと付加情報は配送中の上限の分を確保してあるため, 上限を超えて配送しない. */
+    if (LIMIT_BROADCASTS <= atomic_fetch_add(&self->broadcasts, 1)) {
+        atomic_fetch_sub(&self->broadcasts, 1);
+        errno = ENOMEM;
+        return -1;
+    }
+    struct TaskPool *pool = self->pool;
+    struct Broadcast *record = (struct Broadcast *)malloc(sizeof(*record));
+    if (record == NULL) {
+        atomic_fetch_sub(&self->broadcasts, 1);
+        return -1;
+    }
+    struct TaskExtension *ext = NULL;
+    uint32_t extension = 0;
+    if ((index <= 0) || (group != NULL)) {
+        ext = AllocExtension(self, 0, &extension);
+        if (ext == NULL) {
+            free(record);
+            atomic_fetch_sub(&self->broadcasts, 1);
+            return -1;
+        }
+        *ext = (struct TaskExtension){
+            .function = function,
+            .group = group,
+            .deadline = 0,
+            .generation = 0,
+            .tag = 0,
+            .retry = 0,
+        };
+    }
+    uint32_t ticket;
+    if (IssueTicket(self, 0, extension, &ticket) != 0) {
+        FreeExtension(self, extension);
+        free(record);
+        atomic_fetch_sub(&self->broadcasts, 1);
+        return -1;
+    }
+    *record = (struct Broadcast){
+        .owner = self,
+        .cargo = {
+            .ticket = ticket,
+            .function = (index < 0) ? 0 : index,
+            .flags = CARGO_SHARED,
+            .arg = item->arg,
+        },
+        .remaining = pool->num_of_workers,
+    };
+    if (group != NULL) {
+        atomic_fetch_add(&group->state, pool->num_of_workers);
+    }
+    atomic_fetch_add(&self->letters, pool->num_of_workers);
+
+    TaskId id = CargoId(self, &record->cargo);
+    for (size_t i = 0; i < pool->num_of_workers; i += 1) {
+        struct BroadcastLetter *letter = &record->letters[i];
+        letter->record = record;
+        letter->next = atomic_load(&pool->mailboxes[i]);
+        while (!atomic_compare_exchange_weak(&pool->mailboxes[i], &letter->next, letter)) {
+        }
+    }
+    /* 休止中の Worker は受信箱を確認しないため, すべて起こす. */
+    lock (&pool->mutex) {
+        pthread_cond_broadcast(&pool->inqueue);
+        pthread_cond_broadcast(&pool->helpable);
+    }
+
+    return id;
+}
+
+/**
+ *  fd の監視表で fd の位置を求める.
+ *
+ *  @param  [in]    self    Task Queue オブジェクト.
+ *  @param  [in]    fd      検索する fd.
+ *  @return fd の要素, または fd を追加できる空きの要素が返る.
+ *  @pre    reactor_mutex を取得していること.
+ */
+static struct FdWatch *LookupWatch(struct TaskQueue *self, int fd)
+{
+    size_t pos = ((uint32_t)fd * UINT32_C(2654435761)) & self->watch_mask;
+    while ((self->watches[pos].fd != -1) && (self->watches[pos].fd != fd)) {
+        pos = (pos + 1) & self->watch_mask;
+    }
+
+    return &self->watches[pos];
+}
+
+/**
+ *  fd の監視表から要素を削除する.
+ *
+ *  後続の要素を前に詰めるため, 削除済みの印は残らない.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in,out]    watch   削除する要素.
+ *  @pre    reactor_mutex を取得していること.
+ */
+static void RemoveWatch(struct TaskQueue *self, struct FdWatch *watch)
+{
+    size_t hole = watch - self->watches;
+    size_t pos = hole;
+    while (true) {
+        pos = (pos + 1) & self->watch_mask;
+        if (self->watches[pos].fd == -1) {
+            break;
+        }
+        size_t home = ((uint32_t)self->watches[pos].fd * UINT32_C(2654435761)) & self->watch_mask;
+        /* 本来の位置が空きより後ろにある要素は移動できない. */
+        if (((pos - home) & self->watch_mask) < ((pos - hole) & self->watch_mask)) {
+            continue;
+        }
+        self->watches[hole] = self->watches[pos];
+        hole = pos;
+    }
+    self->watches[hole].fd = -1;
+    self->num_of_watches -= 1;
+}
+
+/**
+ *  準備完了になった fd のタスクを予約する.
+ *
+ *  予約できなかった場合は, TS_DROPPED をコールバックに通知する.
+ *  受け入れ方針が AP_CALLER_RUNS の場合も, Reactor のスレッドでは実行せずに拒否する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in]        fd      準備完了になった fd.
+ */
+static void FireWatch(struct TaskQueue *self, int fd)
+{
+    bool fired = false;
+    struct TaskItemCargo cargo;
+    lock (&self->reactor_mutex) {
+        struct FdWatch *watch = LookupWatch(self, fd);
+        if ((watch->fd == fd) && watch->armed) {
+            watch->armed = false;
+            cargo = watch->cargo;
+            fired = true;
+        }
+    }
+    if (!fired) {
+        return;
+    }
+
+    /* 呼び出し元で実行すると Reactor が塞がり, 他の fd の準備完了を待てなくなるため,
+     * その場合は予約を拒否する.
+     */
+    enum AdmissionPolicy admission = (self->admission == AP_CALLER_RUNS)
+                                     ? AP_REJECT : self->admission;
+    struct TaskFunction function = *CargoFunction(self, &cargo);
+    TaskId id = CargoId(self, &cargo);
+    if (SubmitCargo(self, &cargo, NULL, admission) < 0) {
+        if (function.Callback != NullCallback) {
+            function.Callback(id, TS_DROPPED, cargo.arg);
+        }
+        ReleaseArg(self, cargo.arg);
+    }
+}
+
+/**
+ *  fd の準備完了を待ち, タスクを予約する Reactor.
+ *
+ *  fd は EPOLLONESHOT で登録するため, 準備完了は再登録までに 1 度だけ通知され,
+ *  その間の複数の準備完了は 1 件のタスクにまとめられる.
+ *
+ *  @param  [in]    arg Task Queue オブジェクト.
+ *  @pre    @c arg の非 NULL は呼び出し側で保証すること.
+ */
+static void *Reactor(void *arg)
+{
+    struct TaskQueue *self = (struct TaskQueue *)arg;
+    bool alive = true;
+
+    while (alive) {
+        struct epoll_event events[REACTOR_EVENTS];
+        int n = epoll_wait(self->epoll_fd, events, REACTOR_EVENTS, -1);
+        for (int i = 0; i < n; i += 1) {
+            if (events[i].data.fd == self->reactor_fd) {
+                alive = false;
+            } else {
+                FireWatch(self, events[i].data.fd);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ *  Reactor の資源を確保する.
+ *
+ *  Reactor のスレッドは, 最初に fd を監視する時に起動する.
+ *
+ *  @param  [in,out]    self        Task Queue オブジェクト.
+ *  @param  [in]        watches     監視できる fd の数.
+ *  @return 成功時は, 0 が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ */
+static int ReactorCreate(struct TaskQueue *self, size_t watches)
+{
+    /* 負荷率を 1/2 以下に保つため, 監視できる数の 2 倍以上の 2 のべき乗にする. */
+    size_t slots = 2;
+    while (slots < (watches * 2)) {
+        slots <<= 1;
+    }
+    self->watches = (struct FdWatch *)malloc(sizeof(struct FdWatch) * slots);
+    if (self->watches == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < slots; i += 1) {
+        self->watches[i].fd = -1;
+    }
+    self->watch_limit = watches;
+    self->watch_mask = slots - 1;
+
+    self->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (self->epoll_fd < 0) {
+        return -1;
+    }
+    self->reactor_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (self->reactor_fd < 0) {
+        return -1;
+    }
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.fd = self->reactor_fd,
+    };
+
+    return epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, self->reactor_fd, &event);
+}
+
+/**
+ *  Reactor のスレッドを終了させる.
+ *
+ *  準備完了を待っている fd のタスクは破棄する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ */
+static void StopReactor(struct TaskQueue *self)
+{
+    if (self->watches == NULL) {
+        return;
+    }
+
+    bool running = false;
+    lock (&self->reactor_mutex) {
+        running = self->reactor_running;
+        self->reactor_running = false;
+    }
+    if (running) {
+        eventfd_write(self->reactor_fd, 1);
+        pthread_join(self->reactor, NULL);
+    }
+
+    lock (&self->reactor_mutex) {
+        for (size_t i = 0; i <= self->watch_mask; i += 1) {
+            struct FdWatch *watch = &self->watches[i];
+            if ((watch->fd != -1) && watch->armed) {
+                watch->armed = false;
+                FinishTask(self, &watch->cargo);
+            }
+        }
+    }
+}
+
+/**
+ *  Worker プールのファイバーを確保する.
+ *
+ *  スタックは 1 つの領域にまとめて確保し, 各スタックの伸長方向の先に
+ *  アクセスできないガードページを置く. スタックが溢れた場合は,
+ *  隣のスタックを壊さずに SIGSEGV となる.
+ *  スタックの物理メモリは使用した分のみ割り当てられる.
+ *
+ *  @param  [in,out]    self        Worker プール.
+ *  @param  [in]        count       ファイバーの数.
+ *  @param  [in]        stack_bytes スタックのバイト数. 0 の場合は既定値.
+ *  @return 成功時は, 0 が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ */
+static int FiberSetup(struct TaskPool *self, size_t count, size_t stack_bytes)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (stack_bytes == 0) {
+        stack_bytes = DEFAULT_FIBER_STACK_BYTES;
+    }
+    stack_bytes = (stack_bytes + page - 1) & ~(page - 1);
+    size_t stride = page + stack_bytes;
+    if ((SIZE_MAX / stride) < count) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    struct Fiber *fibers = (struct Fiber *)calloc(count, sizeof(*fibers));
+    if (fibers == NULL) {
+        return -1;
+    }
+    uint8_t *memory = (uint8_t *)mmap(NULL, stride * count, PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (memory == MAP_FAILED) {
+        free(fibers);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i += 1) {
+        uint8_t *guard = memory + (stride * i);
+        if (mprotect(guard, page, PROT_NONE) != 0) {
+            munmap(memory, stride * count);
+            free(fibers);
+            return -1;
+        }
+        fibers[i].stack = guard + page;
+        fibers[i].next = (i + 1 < count) ? &fibers[i + 1] : NULL;
+    }
+
+    self->fiber_limit = count;
+    self->fiber_stack_bytes = stack_bytes;
+    self->fiber_mapped = stride * count;
+    self->fiber_memory = memory;
+    self->fibers = fibers;
+    self->free_fibers = fibers;
+
+    return 0;
+}
+
+/**
+ *  Worker プールを生成する.
+ *
+ *  Worker はまだ起動しない. Task Queue を登録してから PoolStart() で起動する.
+ *
+ *  @param  [in]    workers     ワーカー数.
+ *  @param  [in]    attr        属性.
+ *  @param  [in]    exclusive   1 つの Task Queue が専有するか.
+ *  @return 成功時は, 確保および初期化した Worker プールのポインタが返る.
+ *          失敗時は, NULL が返り, errno が適切に設定される.
+ */
+static struct TaskPool *PoolCreate(size_t workers, const struct TaskQueueAttr *attr, bool exclusive)
+{
+    struct TaskPool *self = (struct TaskPool *)malloc(sizeof(*self));
+    if (self == NULL) {
+        return NULL;
+    }
+    *self = (struct TaskPool){
+        .num_of_workers = workers,
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .idle_policy = attr->idle_policy,
+        .spin_ns = (attr->spin_ns == 0) ? DEFAULT_SPIN_NS : attr->spin_ns,
+        .yields = attr->yields,
+        .last_arrival = 0,
+        .arrival_interval = 0,
+        .sleepers = 0,
+        .helpers = 0,
+        .wakeup_at = 0,
+        .exclusive = exclusive,
+        .drain_mutex = PTHREAD_MUTEX_INITIALIZER,
+        .draining = 0,
+        .num_of_queues = 0,
+        .cursor = 0,
+        .WorkerInit = attr->WorkerInit,
+        .WorkerFini = attr->WorkerFini,
+        .worker_ctx = attr->worker_ctx,
+        .scratch_bytes = attr->scratch_bytes,
+        .num_of_started = 0,
+        .mailboxes = {NULL},
+        .watchdog_ns = (uint64_t)attr->watchdog_ms * 1000000,
+        .TaskStuck = attr->TaskStuck,
+        .watchdog_ctx = attr->watchdog_ctx,
+        .watchdog_mutex = PTHREAD_MUTEX_INITIALIZER,
+        .closing = false,
+        .stuck = 0,
+        .spare_limit = attr->spare_workers,
+        .spares = 0,
+        .stamps = {{0}},
+        .spawn_capacity = attr->spawn_capacity,
+        .spawned = false,
+        .local_memory = NULL,
+        .fiber_limit = 0,
+        .fiber_stack_bytes = 0,
+        .fiber_mapped = 0,
+        .fiber_memory = NULL,
+        .fibers = NULL,
+        .free_fibers = NULL,
+    };
+    if (attr->spawn_capacity > 0) {
+        ssize_t local_size = Deque_ComputeSize(&self->locals[0], sizeof(struct LocalTask),
+                                               attr->spawn_capacity);
+        if ((local_size < 0) || ((self->local_memory = malloc(local_size * workers)) == NULL)) {
+            free(self);
+            return NULL;
+        }
+        for (size_t i = 0; i < workers; i += 1) {
+            Deque_ComputeSize(&self->locals[i], sizeof(struct LocalTask), attr->spawn_capacity);
+            Deque_Bind(&self->locals[i], (uint8_t *)self->local_memory + (local_size * i));
+        }
+    }
+    if ((attr->fiber_stacks > 0)
+        && (FiberSetup(self, attr->fiber_stacks, attr->fiber_stack_bytes) != 0)) {
+        free(self->local_memory);
+        free(self);
+        return NULL;
+    }
+    for (size_t i = 0; i < LIMIT_WORKERS; i += 1) {
+        self->spare_slots[i] = (struct SpareSlot){
+            .pool = self,
+            .state = SS_FREE,
+        };
+    }
+    pthread_spin_init(&self->sched, PTHREAD_PROCESS_PRIVATE);
+    pthread_spin_init(&self->fiber_lock, PTHREAD_PROCESS_PRIVATE);
+
+    /* 起床時刻は MonotonicNs() で扱うため, 条件変数も単調増加する時計を用いる. */
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&self->inqueue, &condattr);
+    pthread_cond_init(&self->helpable, &condattr);
+    pthread_cond_init(&self->drained, &condattr);
+    pthread_cond_init(&self->watchdog_cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+
+    return self;
+}
+
+/**
+ *  Worker を起動していない Worker プールを解放する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ */
+static void PoolRelease(struct TaskPool *self)
+{
+    pthread_cond_destroy(&self->watchdog_cond);
+    pthread_cond_destroy(&self->drained);
+    pthread_cond_destroy(&self->helpable);
+    pthread_cond_destroy(&self->inqueue);
+    pthread_spin_destroy(&self->fiber_lock);
+    pthread_spin_destroy(&self->sched);
+    if (self->fiber_memory != NULL) {
+        munmap(self->fiber_memory, self->fiber_mapped);
+    }
+    free(self->fibers);
+    free(self->local_memory);
+    free(self);
+}
+
+/**
+ *  Worker プールの Worker を起動する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @return 成功時は, 0 が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ *          失敗時は, 起動済みの Worker はすべて終了している.
+ */
+static int PoolStart(struct TaskPool *self)
+{
+    for (size_t i = 0; i < self->num_of_workers; i += 1) {
+        int ret = pthread_create(&self->thrd_ids[i], NULL, Worker, self);
+        if (ret != 0) {
+            for (size_t j = 0; j < i; j += 1) {
+                pthread_cancel(self->thrd_ids[j]);
+            }
+            for (size_t j = 0; j < i; j += 1) {
+                pthread_join(self->thrd_ids[j], NULL);
+            }
+            errno = ret;
+            return -1;
+        }
+    }
+    if (self->watchdog_ns > 0) {
+        int ret = pthread_create(&self->watchdog, NULL, Watchdog, self);
+        if (ret != 0) {
+            for (size_t i = 0; i < self->num_of_workers; i += 1) {
+                pthread_cancel(self->thrd_ids[i]);
+            }
+            for (size_t i = 0; i < self->num_of_workers; i += 1) {
+                pthread_join(self->thrd_ids[i], NULL);
+            }
+            errno = ret;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *  Worker プールの Worker を終了し, Worker プールを解放する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ */
+static void PoolDestroy(struct TaskPool *self)
+{
+    StopWatchdog(self);
+    for (size_t i = 0; i < self->num_of_workers; i += 1) {
+        pthread_cancel(self->thrd_ids[i]);
+    }
+    for (size_t i = 0; i < self->num_of_workers; i += 1) {
+        pthread_join(self->thrd_ids[i], NULL);
+    }
+    /* 実行されなかった全 Worker 宛てタスクは破棄する. */
+    for (size_t i = 0; i < self->num_of_workers; i += 1) {
+        for (struct BroadcastLetter *letter = self->mailboxes[i]; letter != NULL; ) {
+            struct BroadcastLetter *next = letter->next;
+            DeliverLetter(letter->record);
+            letter = next;
+        }
+    }
+    PoolRelease(self);
+}
+
+/**
+ *  Worker プールに Task Queue を登録する.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [in,out]    que     登録する Task Queue.
+ *  @return 成功時は, 0 が返る.
+ *          失敗時は, -1 が返り, errno が適切に設定される.
+ */
+static int PoolAttach(struct TaskPool *self, struct TaskQueue *que)
+{
+    int ret = 0;
+
+    pthread_spin_lock(&self->sched);
+    if (self->num_of_queues < LIMIT_QUEUES) {
+        self->queues[self->num_of_queues] = que;
+        self->num_of_queues += 1;
+    } else {
+        ret = ENOSPC;
+    }
+    pthread_spin_unlock(&self->sched);
+
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ *  Worker プールから Task Queue の登録を解除する.
+ *
+ *  登録の解除後は, Worker が新たに @c que からタスクを取り出すことはない.
+ *
+ *  @param  [in,out]    self    Worker プール.
+ *  @param  [in,out]    que     登録を解除する Task Queue.
+ */
+static void PoolDetach(struct TaskPool *self, struct TaskQueue *que)
+{
+    pthread_spin_lock(&self->sched);
+    for (size_t i = 0; i < self->num_of_queues; i += 1) {
+        if (self->queues[i] == que) {
+            self->num_of_queues -= 1;
+            self->queues[i] = self->queues[self->num_of_queues];
+            self->cursor = 0;
+            break;
+        }
+    }
+    pthread_spin_unlock(&self->sched);
+}
+
+/**
+ *  Task Queue を解放する.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ */
+static void QueueRelease(struct TaskQueue *self)
+{
+    StopReactor(self);
+    free(self->watches);
+    free(self->coalesce);
+    if (self->reactor_fd >= 0) {
+        close(self->reactor_fd);
+    }
+    if (self->epoll_fd >= 0) {
+        close(self->epoll_fd);
+    }
+    for (size_t i = 0; i < self->num_of_classes; i += 1) {
+        free(self->classes[i]);
+    }
+    free(self->arg_memory);
+    free(self->completion_memory);
+    if (self->completion_fd >= 0) {
+        close(self->completion_fd);
+    }
+    pthread_cond_destroy(&self->blocking_cond);
+    pthread_spin_destroy(&self->registry);
+    pthread_spin_destroy(&self->edf);
+    free(self);
+}
+
+/**
+ *  Task Queue を生成する.
+ *
+ *  @param  [in,out]    pool        タスクを実行する Worker プール.
+ *  @param  [in]        capacity    キューの容量.
+ *  @param  [in]        attr        属性.
+ *  @return 成功時は, 確保および初期化したオブジェクトのポインタが返る.
+ *          失敗時は, NULL が返り, errno が適切に設定される.
+ */
+static struct TaskQueue *QueueCreate(struct TaskPool *pool, size_t capacity,
+                                     const struct TaskQueueAttr *attr)
+{
+    if ((AP_LENGTH <= (unsigned int)attr->admission) || (capacity <= attr->headroom)
+        || ((attr->coalesce_slots & (attr->coalesce_slots - 1)) != 0)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct Queue que;
+    ssize_t pool_size = Queue_ComputeSize(&que, sizeof(struct TaskItemCargo), capacity);
+    if (pool_size < 0) {
+        return NULL;
+    }
+    pool_size = (pool_size + 7) & ~7;
+    /* 期限順に並べない場合はヒープの領域を確保しない. */
+    struct Heap heap = {.capacity = 0};
+    ssize_t heap_size = 0;
+    if (attr->edf_capacity > 0) {
+        heap_size = Heap_ComputeSize(&heap, sizeof(struct TaskItemCargo), attr->edf_capacity);
+        if (heap_size < 0) {
+            return NULL;
+        }
+        heap_size = (heap_size + 7) & ~7;
+    }
+    /* ブロッキングタスクを使わない場合はキューの領域を確保しない. */
+    struct Queue blocking_que = {.val_bytes = 0};
+    ssize_t blocking_size = 0;
+    if (attr->blocking_workers > 0) {
+        blocking_size = Queue_ComputeSize(&blocking_que, sizeof(struct TaskItemCargo), capacity);
+        if (blocking_size < 0) {
+            return NULL;
+        }
+        blocking_size = (blocking_size + 7) & ~7;
+    }
+
+    /* 付加情報は, 各キューとローカルバッファの容量に実行中のタスクと
+     * fd の準備完了を待つタスク, ファイバーで中断中のタスク, 配送中の全 Worker 宛てタスクの
+     * 分を加えて確保する. 流量制限クラスのタスクは, クラスごとの領域を使用する.
+     */
+    struct MemoryPool extensions;
+    size_t num_of_extensions = capacity + attr->edf_capacity + LIMIT_PARTICIPANTS
+                               + (pool->spawn_capacity * pool->num_of_workers) + attr->fd_watches
+                               + pool->fiber_limit + LIMIT_BROADCASTS;
+    if (attr->blocking_workers > 0) {
+        num_of_extensions += capacity + attr->blocking_workers;
+    }
+    ssize_t extension_size = MemoryPool_ComputeSize(&extensions, sizeof(struct TaskExtension),
+                                                    num_of_extensions);
+    if (extension_size < 0) {
+        return NULL;
+    }
+    /* チケットは, 付加情報と同じ数を確保する.
+     * タスク識別子のうち, チケットの番号に使わないビットはすべて世代に使う.
+     * 流量制限クラスの領域の位置も同じビット数で表すため, クラスの容量は
+     * Task Queue の容量以下とする.
+     */
+    struct MemoryPool tickets;
+    ssize_t ticket_size = MemoryPool_ComputeSize(&tickets, sizeof(struct TaskTicket),
+                                                 num_of_extensions);
+    if (ticket_size < 0) {
+        return NULL;
+    }
+    unsigned int slot_bits = 0;
+    while ((UINT64_C(1) << slot_bits) < num_of_extensions) {
+        slot_bits += 1;
+    }
+    if ((sizeof(uint32_t) * CHAR_BIT) < (slot_bits + TICKET_BOOK_BITS)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    size_t issued_size = sizeof(_Atomic(uint32_t)) << slot_bits;
+
+    /* タスク引数スラブはサイズクラスごとに同数のブロックを持つ. */
+    struct MemoryPool args[ARG_SIZE_CLASSES] = {0};
+    ssize_t arg_offsets[ARG_SIZE_CLASSES + 1] = {0};
+    if (attr->arg_slots > 0) {
+        for (size_t i = 0; i < ARG_SIZE_CLASSES; i += 1) {
+            ssize_t slab_size = MemoryPool_ComputeSize(&args[i], ARG_MIN_BYTES << i,
+                                                       attr->arg_slots);
+            if (slab_size < 0) {
+                return NULL;
+            }
+            arg_offsets[i + 1] = arg_offsets[i] + slab_size;
+        }
+    }
+
+    /* 完了リングを使わない場合は, タスク状態を記録しない. */
+    struct Ring completions = {.mask = 0};
+    ssize_t completion_size = 0;
+    unsigned int events = 0;
+    if (attr->completion_capacity > 0) {
+        completion_size = Ring_ComputeSize(&completions, sizeof(struct TaskCompletion),
+                                           attr->completion_capacity);
+        if (completion_size < 0) {
+            return NULL;
+        }
+        events = (attr->completion_events != 0)
+                 ? attr->completion_events
+                 : (TS_MASK(TS_SUCCESS) | TS_MASK(TS_FAIL) | TS_MASK(TS_EXPIRED)
+                    | TS_MASK(TS_DROPPED));
+    }
+
+    struct TaskQueue *self = (struct TaskQueue *)malloc(sizeof(*self) + pool_size + heap_size
+                                                        + blocking_size + extension_size
+                                                        + ticket_size + issued_size);
+    if (self == NULL) {
+        return NULL;
+    }
+    void *arg_memory = NULL;
+    if (attr->arg_slots > 0) {
+        arg_memory = malloc(arg_offsets[ARG_SIZE_CLASSES]);
+        if (arg_memory == NULL) {
+            free(self);
+            return NULL;
+        }
+    }
+    void *completion_memory = NULL;
+    int completion_fd = -1;
+    if (completion_size > 0) {
+        completion_memory = malloc(completion_size);
+        if (completion_memory != NULL) {
+            completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        }
+        if (completion_fd < 0) {
+            int err = errno;
+            free(completion_memory);
+            free(arg_memory);
+            free(self);
+            errno = err;
+            return NULL;
+        }
+    }
+    *self = (struct TaskQueue){
+        .pool = pool,
+        .owns_pool = false,
+        .total_tasks = 0,
+        .suspended = true,
+        .weight = (attr->weight == 0) ? 1 : attr->weight,
+        .max_concurrency = attr->max_concurrency,
+        .counted = !pool->exclusive || (attr->max_concurrency != 0),
+        .running = 0,
+        .deficit = 0,
+        .num_of_classes = 0,
+        .rotation = 0,
+        .urgent = 0,
+        .heap = heap,
+        .generations = {0},
+        .num_of_functions = 1,
+        .book = {
+            .extensions = extensions,
+            .tickets = tickets,
+        },
+        .slot_bits = slot_bits,
+        .ticket_bits = slot_bits + TICKET_BOOK_BITS,
+        .generation_mask = INT64_MAX >> (slot_bits + TICKET_BOOK_BITS),
+        .displaced = 0,
+        .arg_memory = arg_memory,
+        .events = events,
+        .overflow = 0,
+        .completions = completions,
+        .completion_memory = completion_memory,
+        .completion_fd = completion_fd,
+        .blocking_mutex = PTHREAD_MUTEX_INITIALIZER,
+        .blocking_limit = attr->blocking_workers,
+        .blocking_threads = 0,
+        .blocking_idle = 0,
+        .blocking_pending = 0,
+        .closing = false,
+        .letters = 0,
+        .broadcasts = 0,
+        .blocking_que = blocking_que,
+        .admission = attr->admission,
+        .headroom = attr->headroom,
+        .admission_limit = capacity - attr->headroom,
+        .backlog = 0,
+        .reactor_mutex = PTHREAD_MUTEX_INITIALIZER,
+        .epoll_fd = -1,
+        .reactor_fd = -1,
+        .reactor_running = false,
+        .watch_limit = 0,
+        .num_of_watches = 0,
+        .watch_mask = 0,
+        .watches = NULL,
+        .coalesce_mask = 0,
+        .coalesce = NULL,
+        .que = que,
+    };
+    pthread_spin_init(&self->edf, PTHREAD_PROCESS_PRIVATE);
+    pthread_spin_init(&self->registry, PTHREAD_PROCESS_PRIVATE);
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&self->blocking_cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+    Queue_Bind(&self->que, self->reserved);
+    if (heap.capacity > 0) {
+        Heap_Bind(&self->heap, self->reserved + pool_size);
+    }
+    if (blocking_size > 0) {
+        Queue_Bind(&self->blocking_que, self->reserved + pool_size + heap_size);
+    }
+    MemoryPool_Bind(&self->book.extensions,
+                    self->reserved + pool_size + heap_size + blocking_size);
+    /* AntTQ_CancelRange() が未使用のチケットを走査できるよう, 状態を 0 にしておく. */
+    uint8_t *ticket_memory = self->reserved + pool_size + heap_size + blocking_size + extension_size;
+    memset(ticket_memory, 0, ticket_size);
+    MemoryPool_Bind(&self->book.tickets, ticket_memory);
+    self->issued = (_Atomic(uint32_t) *)(ticket_memory + ticket_size);
+    memset(self->issued, 0, issued_size);
+    for (size_t i = 0; (arg_memory != NULL) && (i < ARG_SIZE_CLASSES); i += 1) {
+        self->args[i] = args[i];
+        MemoryPool_Bind(&self->args[i], (uint8_t *)arg_memory + arg_offsets[i]);
+    }
+    if (completion_memory != NULL) {
+        Ring_Bind(&self->completions, completion_memory);
+    }
+    if (attr->coalesce_slots > 0) {
+        self->coalesce_mask = attr->coalesce_slots - 1;
+        self->coalesce = (_Atomic(uint64_t) *)calloc(attr->coalesce_slots, sizeof(*self->coalesce));
+    }
+    if (((attr->coalesce_slots > 0) && (self->coalesce == NULL))
+        || ((attr->fd_watches > 0) && (ReactorCreate(self, attr->fd_watches) != 0))) {
+        int err = errno;
+        QueueRelease(self);
+        errno = err;
+        return NULL;
+    }
+
+    return self;
+}
+
+/**
+ *  @details    指定の容量, ワーカー数で Task Queue を生成する.
+ *
+ *  @param      [in]    capacity    キューの容量.
+ *  @param      [in]    workers     ワーカー数.
+ *  @return     成功時は, 確保および初期化したオブジェクトのポインタを返る.
+ *              失敗時は, NULL が返り, errno が適切に設定される.
+ */
+struct TaskQueue *AntTQ_Init(size_t capacity, size_t workers)
+{
+    return AntTQ_InitAttr(capacity, workers, NULL);
+}
+
+/**
+ *  @details    指定の容量, ワーカー数, 属性で Task Queue を生成する.
+ *              生成した Task Queue は Worker を専有する.
+ *              ワーカー数が 0 の場合は, AntTQ_RunPending() を呼び出したスレッドで
+ *              タスクを実行する.
+ *
+ *  @param      [in]    capacity    キューの容量.
+ *  @param      [in]    workers     ワーカー数.
+ *  @param      [in]    attr        属性. NULL の場合は既定値を用いる.
+ *  @return     成功時は, 確保および初期化したオブジェクトのポインタを返る.
+ *              失敗時は, NULL が返り, errno が適切に設定される.
+ */
+struct TaskQueue *AntTQ_InitAttr(size_t capacity, size_t workers,
+                                 const struct TaskQueueAttr *attr)
+{
+    struct TaskQueueAttr defaults = TASK_QUEUE_ATTR_INITIALIZER;
+    if (attr == NULL) {
+        attr = &defaults;
+    }
+    if ((capacity == 0) || (LIMIT_CAPACITY < capacity) || (LIMIT_WORKERS < workers)
+        || (IP_LENGTH <= (unsigned int)attr->idle_policy) || (LIMIT_WORKERS < attr->spare_workers)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct TaskPool *pool = PoolCreate(workers, attr, true);
+    if (pool == NULL) {
+        return NULL;
+    }
+    struct TaskQueue *self = QueueCreate(pool, capacity, attr);
+    if (self == NULL) {
+        PoolRelease(pool);
+        return NULL;
+    }
+    self->owns_pool = true;
+    PoolAttach(pool, self);
+
+    if (PoolStart(pool) != 0) {
+        int err = errno;
+        PoolRelease(pool);
+        QueueRelease(self);
+        errno = err;
+        return NULL;
+    }
+
+    return self;
+}
+
+/**
+ *  @details    @c self を解放する.
+ *              @c self は AntTQ_Init(), AntTQ_InitAttr(), AntTQ_InitOnPool() の
+ *              戻り値である必要がある.
+ *              Worker プールを共有している場合は, 実行中のタスクの完了を待つ.
+ *              実行中のブロッキングタスクがある場合も, その完了を待つ.
+ *              未実行のタスクは破棄される. 未実行のブロッキングタスクには,
+ *              呼び出し元のスレッドで TS_CANCELED が通知される.
+ *              AntTQ_Await(), AntTQ_YieldFiber() で待っているタスクは待機を打ち切られ,
+ *              TS_CANCELED が通知される. Worker プールを専有している場合,
+ *              中断中のファイバーは再開されずに破棄される.
+ *
+ *  @param      [in,out]    self  Task Queue オブジェクト.
+ */
+void AntTQ_Term(struct TaskQueue *self)
+{
+    if (self != NULL) {
+        StopReactor(self);
+        StopBlocking(self);
+        if (self->owns_pool) {
+            PoolDestroy(self->pool);
+        } else {
+            struct TaskPool *pool = self->pool;
+            atomic_fetch_add(&pool->draining, 1);
+            atomic_store(&self->suspended, true);
+            PoolDetach(pool, self);
+            /* 完了を待つ待機者と, 中断中のファイバーを持つ Worker に終了処理の開始を知らせる. */
+            lock (&pool->mutex) {
+                pthread_cond_broadcast(&pool->inqueue);
+                pthread_cond_broadcast(&pool->helpable);
+            }
+            lock (&pool->drain_mutex) {
+                while ((atomic_load(&self->running) > 0) || (atomic_load(&self->letters) > 0)) {
+                    pthread_cond_wait(&pool->drained, &pool->drain_mutex);
+                }
+            }
+            atomic_fetch_sub(&pool->draining, 1);
+        }
+        QueueRelease(self);
+    }
+}
+
+/**
+ *  @details    複数の Task Queue が共有する Worker プールを生成する.
+ *              @c attr のうち, アイドル戦略と Worker に関する属性が用いられる.
+ *
+ *  @param      [in]    workers     ワーカー数.
+ *  @param      [in]    attr        属性. NULL の場合は既定値を用いる.
+ *  @return     成功時は, 確保および初期化した Worker プールのポインタが返る.
+ *              失敗時は, NULL が返り, errno が適切に設定される.
+ */
+struct TaskPool *AntTQ_PoolInit(size_t workers, const struct TaskQueueAttr *attr)
+{
+    struct TaskQueueAttr defaults = TASK_QUEUE_ATTR_INITIALIZER;
+    if (attr == NULL) {
+        attr = &defaults;
+    }
+    if ((workers == 0) || (LIMIT_WORKERS < workers)
+        || (IP_LENGTH <= (unsigned int)attr->idle_policy) || (LIMIT_WORKERS < attr->spare_workers)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct TaskPool *self = PoolCreate(workers, attr, false);
+    if (self == NULL) {
+        return NULL;
+    }
+    if (PoolStart(self) != 0) {
+        int err = errno;
+        PoolRelease(self);
+        errno = err;
+        return NULL;
+    }
+
+    return self;
+}
+
+/**
+ *  @details    @c self を解放する.
+ *              共有している Task Queue は, 事前に AntTQ_Term() で解放すること.
+ *
+ *  @param      [in,out]    self    Worker プール.
+ */
+void AntTQ_PoolTerm(struct TaskPool *self)
+{
+    if (self != NULL) {
+        PoolDestroy(self);
+    }
+}
+
+/**
+ *  @details    @c pool を共有する Task Queue を生成する.
+ *              @c attr のうち, 重み, 同時実行数の上限, 期限順に並べるタスク数の上限,
+ *              タスク引数スラブの領域数, 完了リングに関する属性,
+ *              ブロッキングタスク用スレッド数の上限が用いられる.
+ *              Worker プールは各 Task Queue の重みに比例した割合でタスクを実行する.
+ *
+ *  @param      [in,out]    pool        タスクを実行する Worker プール.
+ *  @param      [in]        capacity    キューの容量.
+ *  @param      [in]        attr        属性. NULL の場合は既定値を用いる.
+ *  @return     成功時は, 確保および初期化したオブジェクトのポインタを返る.
+ *              失敗時は, NULL が返り, errno が適切に設定される.
+ *              共有できる Task Queue の数を超えた場合は, errno に ENOSPC が設定される.
+ */
+struct TaskQueue *AntTQ_InitOnPool(struct TaskPool *pool, size_t capacity,
+                                   const struct TaskQueueAttr *attr)
+{
+    struct TaskQueueAttr defaults = TASK_QUEUE_ATTR_INITIALIZER;
+    if (attr == NULL) {
+        attr = &defaults;
+    }
+    if ((pool == NULL) || pool->exclusive || (capacity == 0) || (LIMIT_CAPACITY < capacity)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct TaskQueue *self = QueueCreate(pool, capacity, attr);
+    if (self == NULL) {
+        return NULL;
+    }
+    if (PoolAttach(pool, self) != 0) {
+        QueueRelease(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+int AntTQ_Start(struct TaskQueue *self)
+{
+    if (self == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    atomic_store(&self->suspended,  false);
+    lock (&self->pool->mutex) {
+        pthread_cond_broadcast(&self->pool->inqueue);
+        pthread_cond_broadcast(&self->pool->helpable);
+    }
+    lock (&self->blocking_mutex) {
+        pthread_cond_broadcast(&self->blocking_cond);
+    }
+
+    return 0;
+}
+
+int AntTQ_Stop(struct TaskQueue *self)
+{
+    if (self == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    atomic_store(&self->suspended, true);
+
+    return 0;
+}
+
+/**
+ *  @details    予約済みのタスクを, 呼び出し元のスレッドで実行する.
+ *              タスクは Worker と同じく通知, リトライ, 取り消しの判定を経て実行される.
+ *              ワーカー数 0 で生成した Task Queue は, この関数でのみタスクを実行する.
+ *              実行時間の上限は各タスクの実行後に判定するため, 少なくとも 1 件は実行する.
+ *
+ *  @param      [in,out]    self        Task Queue オブジェクト.
+ *  @param      [in]        max_tasks   実行するタスク数の上限. 0 の場合は上限なし.
+ *  @param      [in]        budget_ns   実行時間の上限 (ナノ秒). 0 の場合は上限なし.
+ *  @return     成功時は, 実行したタスクの数が返る. 停止中の場合は 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+ssize_t AntTQ_RunPending(struct TaskQueue *self, size_t max_tasks, uint64_t budget_ns)
+{
+    if (self == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t deadline = (budget_ns == 0) ? 0 : MonotonicNs() + budget_ns;
+    ssize_t count = 0;
+    struct TaskItemCargo cargo;
+    while (((max_tasks == 0) || ((size_t)count < max_tasks)) && AcquireTask(self, &cargo)) {
+        RunTask(self, &cargo);
+        ReleaseTask(self);
+        count += 1;
+        if ((deadline != 0) && (deadline <= MonotonicNs())) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+/**
+ *  @details    指定のタスクを実行予約する.
+ *              キューが満杯の場合は, @ref TaskQueueAttr::admission に従い,
+ *              予約を拒否するか, 最も古いタスクを破棄するか, 呼び出し元で実行する.
+ *              同じ合流キーの未実行のタスクがある場合は, 新たに予約せず合流する.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [in]        item    予約するタスク情報.
+ *  @return     成功時は, 予約したタスクの識別子が返る.
+ *              合流した場合は, 合流先のタスクの識別子が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+TaskId AntTQ_Enqueue(struct TaskQueue *self, struct TaskItem *item)
+{
+    if ((self == NULL) || (item == NULL) || (item->Task == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return EnqueueItem(self, item, NULL);
+}
+
+/**
+ *  @details    タスク関数を関数表に登録する.
+ *              登録したタスク関数は AntTQ_EnqueueFn() で番号を指定して予約でき,
+ *              キューのノードには関数の番号と引数のみが保持される.
+ *              AntTQ_Enqueue() で予約したタスク関数も, 関数表に空きがあれば自動で登録される.
+ *
+ *  @param      [in,out]    self        Task Queue オブジェクト.
+ *  @param      [in]        Task        タスクとして実行される関数.
+ *  @param      [in]        Callback    タスクの状態変化コールバック. NULL の場合は通知しない.
+ *  @return     成功時は, 1 以上の関数の番号が返る. 登録済みの場合は同じ番号が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              関数表に空きがない場合は, errno に ENOSPC が設定される.
+ */
+int AntTQ_Register(struct TaskQueue *self, bool (*Task)(TaskId id, void *arg),
+                   bool (*Callback)(TaskId id, enum TaskStatus status, void *arg))
+{
+    if ((self == NULL) || (Task == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct TaskFunction function = {
+        .Task = Task,
+        .Callback = (Callback == NULL) ? NullCallback : Callback,
+    };
+    return RegisterFunction(self, &function);
+}
+
+/**
+ *  @details    登録済みのタスク関数を, 既定の属性で実行予約する.
+ *              付加情報を確保しないため, AntTQ_Enqueue() より軽量である.
+ *
+ *  @param      [in,out]    self        Task Queue オブジェクト.
+ *  @param      [in]        function    AntTQ_Register() が返した関数の番号.
+ *  @param      [in]        arg         タスクに渡される引数.
+ *  @return     成功時は, 予約したタスクの識別子が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+TaskId AntTQ_EnqueueFn(struct TaskQueue *self, int function, void *arg)
+{
+    if ((self == NULL) || (function <= 0)
+        || (atomic_load_explicit(&self->num_of_functions, memory_order_acquire) <= (size_t)function)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint32_t ticket;
+    while (IssueTicket(self, 0, 0, &ticket) != 0) {
+        if (!MakeRoom(self, 0)) {
+            return -1;
+        }
+    }
+    struct TaskItemCargo cargo = {
+        .ticket = ticket,
+        .function = function,
+        .flags = 0,
+        .arg = arg,
+    };
+    return SubmitCargo(self, &cargo, NULL, self->admission);
+}
+
+/**
+ *  @details    実行中のタスクから, 子タスクを実行予約する.
+ *              子タスクは実行中の Worker のローカルバッファに後入れ先出しで追加され,
+ *              親タスクを実行している Worker が優先して実行する.
+ *              休止中の Worker は, 古い子タスクから盗み出して実行する.
+ *              子タスクは実行中のタスクと同じ Task Queue に属し,
+ *              親タスクは戻る前にすべての子タスクの完了を待つ.
+ *
+ *  @param      [in,out]    item    予約するタスク情報.
+ *  @return     成功時は, 予約したタスクの識別子が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              タスクの実行中以外に呼び出した場合は, errno に EPERM が設定される.
+ */
+TaskId AntTQ_Spawn(struct TaskItem *item)
+{
+    struct TaskFrame *frame = current_frame;
+    if (frame == NULL) {
+        errno = EPERM;
+        return -1;
+    }
+    if ((item == NULL) || (item->Task == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return SpawnItem(frame, item);
+}
+
+/**
+ *  @details    実行中のタスクが AntTQ_Spawn() で生成した子タスクの完了を待つ.
+ *              待つ間は休止せず, 未実行の子タスクや Task Queue のタスクを実行する.
+ *
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              タスクの実行中以外に呼び出した場合は, errno に EPERM が設定される.
+ */
+int AntTQ_Join(void)
+{
+    struct TaskFrame *frame = current_frame;
+    if (frame == NULL) {
+        errno = EPERM;
+        return -1;
+    }
+
+    if (frame->spawned) {
+        GroupHelpWaitFor(&frame->children, -1);
+    }
+
+    return 0;
+}
+
+/**
+ *  @details    実行中のタスクから, @c id のタスクの取り消しが要求されているかを判定する.
+ *              AntTQ_Cancel(), AntTQ_CancelRange(), AntTQ_CancelTag(),
+ *              AntTQ_GroupCancel() による要求を, 実行を始めた後も確認できる.
+ *              実行中のタスク自身の判定は原子的な読み込みのみで済むため,
+ *              内側のループで繰り返し呼び出してよい.
+ *
+ *  @param      [in]    id  判定するタスク識別子. 実行中のタスクと同じ Task Queue に属すること.
+ *  @return     取り消しが要求されている場合は true が返る.
+ *              タスクの実行中以外に呼び出した場合や, @c id のタスクが実行を終えている場合は
+ *              false が返る.
+ */
+bool AntTQ_IsCancelRequested(TaskId id)
+{
+    struct TaskFrame *frame = current_frame;
+    if (frame == NULL) {
+        return false;
+    }
+    if (id == frame->id) {
+        return IsCanceled(frame->que, frame->cargo);
+    }
+
+    struct TaskTicket *ticket = FindTicket(frame->que, id);
+    return (ticket != NULL)
+           && ((atomic_load_explicit(&ticket->state, memory_order_relaxed)
+                & ~(TICKET_AWAITED | TICKET_DISPLACED))
+               == ((IdGeneration(frame->que, id) << TICKET_GENERATION_SHIFT) | TICKET_CANCELED));
+}
+
+/**
+ *  @details    実行中のタスクから, @c id のタスクが実行を終えるまで待つ.
+ *              ファイバーで実行中のタスクは, ファイバーを中断して Worker を明け渡す.
+ *              待つタスクが実行を終えると Worker が起床し, ファイバーを再開する.
+ *              ファイバー以外で実行中のタスクは, 待つ間に Task Queue のタスクを実行し,
+ *              実行できるタスクがなければ休止する.
+ *              中断中のファイバーは Worker の作業領域を保持しない.
+ *              Task Queue の終了処理が始まった場合は待機を打ち切り, 呼び出したタスクには
+ *              戻った後に TS_CANCELED が通知される.
+ *
+ *  @param      [in]    id  待つタスク識別子. 実行中のタスクと同じ Task Queue に属すること.
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              タスクの実行中以外に呼び出した場合は, errno に EPERM が設定される.
+ *              実行中のタスク自身を待つ場合は, errno に EDEADLK が設定される.
+ *              Task Queue の終了処理で打ち切った場合は, errno に ECANCELED が設定される.
+ */
+int AntTQ_Await(TaskId id)
+{
+    struct TaskFrame *frame = current_frame;
+    if (frame == NULL) {
+        errno = EPERM;
+        return -1;
+    }
+    if (id == frame->id) {
+        errno = EDEADLK;
+        return -1;
+    }
+    struct TaskTicket *ticket = FindTicket(frame->que, id);
+    if (ticket == NULL) {
+        return -1;
+    }
+
+    /* 実行を終えたタスクのチケットは解放され, 世代が一致しなくなる.
+     * 待機者がいることをチケットに記録すれば, 解放時に起床の通知が届く.
+     */
+    struct TaskQueue *que = frame->que;
+    struct TaskPool *pool = que->pool;
+    uint64_t generation = IdGeneration(que, id);
+    while (MarkAwaited(ticket, generation)) {
+        if (atomic_load(&que->closing)) {
+            frame->canceled = true;
+            errno = ECANCELED;
+            return -1;
+        }
+
+        struct Fiber *fiber = current_fiber;
+        if (fiber != NULL) {
+            fiber->awaited = ticket;
+            fiber->generation = generation;
+            ParkFiber(fiber);
+            fiber->awaited = NULL;
+            continue;
+        }
+
+        /* Worker が待つ場合は, 全 Worker 宛てタスクも受け取る. */
+        if (current_worker != NULL) {
+            OpenMailbox(current_worker->pool, current_worker);
+        }
+
+        struct TaskItemCargo cargo;
+        bool found = AcquireTask(que, &cargo);
+        if (!found) {
+            lock (&pool->mutex) {
+                atomic_fetch_add(&pool->helpers, 1);
+                while (((atomic_load(&ticket->state) >> TICKET_GENERATION_SHIFT) == generation)
+                       && !atomic_load(&que->closing) && !(found = AcquireTask(que, &cargo))
+                       && !HasMail()) {
+                    pthread_cond_wait(&pool->helpable, &pool->mutex);
+                }
+                atomic_fetch_sub(&pool->helpers, 1);
+            }
+        }
+        if (found) {
+            RunTask(que, &cargo);
+            ReleaseTask(que);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *  @details    ファイバーで実行中のタスクを中断し, Worker を他のタスクに明け渡す.
+ *              Worker がタスクの合間に再開した時点で戻る.
+ *              Task Queue の終了処理が始まった場合は中断せずに戻り, 呼び出したタスクには
+ *              戻った後に TS_CANCELED が通知される.
+ *
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              ファイバーの実行中以外に呼び出した場合は, errno に EPERM が設定される.
+ *              Task Queue の終了処理が始まった場合は, errno に ECANCELED が設定される.
+ */
+int AntTQ_YieldFiber(void)
+{
+    struct Fiber *fiber = current_fiber;
+    if (fiber == NULL) {
+        errno = EPERM;
+        return -1;
+    }
+    struct TaskFrame *frame = current_frame;
+    if (atomic_load(&frame->que->closing)) {
+        frame->canceled = true;
+        errno = ECANCELED;
+        return -1;
+    }
+
+    ParkFiber(fiber);
+
+    return 0;
+}
+
+/**
+ *  @details    @c fd が準備完了になった時に予約されるタスクを登録する.
+ *              タスクは Worker を塞がずに Reactor のスレッドで準備完了を待ち,
+ *              準備完了になった時点で 1 度だけ予約される.
+ *              続けて待つ場合は, タスクの中などから再度登録する.
+ *              同じ fd の 2 回目以降の登録は, epoll への再登録 1 回で済む.
+ *              fd を閉じる前には AntTQ_UnwatchFd() で監視を解除すること.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [in]        fd      監視する fd.
+ *  @param      [in]        events  待つ準備完了の種類 (EPOLLIN, EPOLLOUT など).
+ *  @param      [in,out]    item    予約するタスク情報.
+ *  @return     成功時は, 予約するタスクの識別子が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              @c fd が準備完了を待っている場合は, errno に EBUSY が設定される.
+ *              監視できる fd の数を超える場合は, errno に ENOMEM が設定される.
+ */
+TaskId AntTQ_EnqueueOnFd(struct TaskQueue *self, int fd, uint32_t events, struct TaskItem *item)
+{
+    if ((self == NULL) || (self->watches == NULL) || (fd < 0) || (events == 0)
+        || (item == NULL) || (item->Task == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct TaskItemCargo cargo;
+    if (PrepareCargo(self, item, NULL, &cargo) != 0) {
+        return -1;
+    }
+    TaskId id = CargoId(self, &cargo);
+
+    int err = 0;
+    lock (&self->reactor_mutex) {
+        struct FdWatch *watch = LookupWatch(self, fd);
+        struct epoll_event event = {
+            .events = events | EPOLLONESHOT,
+            .data.fd = fd,
+        };
+        if (watch->fd == fd) {
+            if (watch->armed) {
+                err = EBUSY;
+            } else if ((epoll_ctl(self->epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0)
+                       && ((errno != ENOENT)
+                           || (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0))) {
+                /* 閉じられた fd は epoll から外れているため, 登録し直す. */
+                err = errno;
+            }
+        } else if (self->num_of_watches >= self->watch_limit) {
+            err = ENOMEM;
+        } else if (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            err = errno;
+        } else {
+            watch->fd = fd;
+            self->num_of_watches += 1;
+        }
+        if ((err == 0) && !self->reactor_running) {
+            err = pthread_create(&self->reactor, NULL, Reactor, self);
+            self->reactor_running = (err == 0);
+        }
+        if (err == 0) {
+            watch->cargo = cargo;
+            watch->armed = true;
+        }
+    }
+    if (err != 0) {
+        ReleaseTicket(self, &cargo);
+        errno = err;
+        return -1;
+    }
+
+    return id;
+}
+
+/**
+ *  @details    @c fd の監視を解除する.
+ *              準備完了を待っているタスクは, 通知せずに破棄する.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [in]        fd      監視を解除する fd.
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              監視していない fd の場合は, errno に ENOENT が設定される.
+ */
+int AntTQ_UnwatchFd(struct TaskQueue *self, int fd)
+{
+    if ((self == NULL) || (self->watches == NULL) || (fd < 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    bool found = false;
+    struct TaskItemCargo cargo;
+    bool armed = false;
+    lock (&self->reactor_mutex) {
+        struct FdWatch *watch = LookupWatch(self, fd);
+        if (watch->fd == fd) {
+            found = true;
+            armed = watch->armed;
+            cargo = watch->cargo;
+            epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            RemoveWatch(self, watch);
+        }
+    }
+    if (!found) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (armed) {
+        FinishTask(self, &cargo);
+    }
+
+    return 0;
+}
+
+/**
+ *  @details    指定のタスクを, Worker プールのすべての Worker で 1 回ずつ実行する.
+ *              タスクは各 Worker の受信箱に配送され, Worker はタスクの合間に
+ *              受信箱を確認して実行するため, 通常のタスクとキューを取り合わない.
+ *              Worker プールを共有している場合は, 共有しているすべての Worker で実行する.
+ *              コールバックは Worker ごとに呼び出される.
+ *              リトライ, 流量制限クラス, ブロッキング, ファイバー, 合流キーは指定できず,
+ *              タグと実行期限, 優先度は無視される.
+ *              受信箱は AntTQ_Stop() で停止中の Task Queue でも確認されるため,
+ *              配送したタスクは停止中も実行される.
+ *              同時に配送中にできるタスクは 64 件までで,
+ *              上限に達している場合は errno に ENOMEM が設定される.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [in]        item    実行するタスク情報.
+ *  @return     成功時は, タスクの識別子が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+TaskId AntTQ_Broadcast(struct TaskQueue *self, struct TaskItem *item)
+{
+    if ((self == NULL) || (item == NULL) || (item->Task == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return BroadcastItem(self, item, NULL);
+}
+
+/**
+ *  @details    @c id のタスクをキューから削除する.
+ *              @c id がすでに実行中の場合は, 取り消し要求としてタスクに通知され,
+ *              タスクは AntTQ_IsCancelRequested() で確認して処理を打ち切れる.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [in]        id  削除対象のタスク識別子.
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              @c id のタスクが実行を終えている場合は, errno に ENOENT が設定される.
+ */
+int AntTQ_Cancel(struct TaskQueue *self, TaskId id)
+{
+    if (self == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct TaskTicket *ticket = FindTicket(self, id);
+    if (ticket == NULL) {
+        return -1;
+    }
+    /* 待機者の有無は保ったまま, 取り消し要求を立てる. */
+    uint64_t generation = IdGeneration(self, id);
+    uint64_t state = atomic_load(&ticket->state);
+    do {
+        if ((generation == 0) || ((state >> TICKET_GENERATION_SHIFT) != generation)) {
+            errno = ENOENT;
+            return -1;
+        }
+        if ((state & TICKET_CANCELED) != 0) {
+            break;
+        }
+    } while (!atomic_compare_exchange_weak(&ticket->state, &state, state | TICKET_CANCELED));
+
+    return 0;
+}
+
+/**
+ *  チケットに, 範囲内のタスク識別子であれば取り消し要求を立てる.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in]        number  チケットの番号.
+ *  @param  [in]        lo      削除対象の先頭のタスク識別子.
+ *  @param  [in]        hi      削除対象の末尾のタスク識別子.
+ */
+static void CancelInRange(struct TaskQueue *self, uint32_t number, TaskId lo, TaskId hi)
+{
+    struct TaskTicket *ticket = TicketAt(self, number);
+    uint64_t state = atomic_load(&ticket->state);
+    do {
+        TaskId id = (TaskId)(((state >> TICKET_GENERATION_SHIFT) << self->ticket_bits) | number);
+        if ((state == 0) || ((state & TICKET_CANCELED) != 0) || (id < lo) || (hi < id)) {
+            break;
+        }
+    } while (!atomic_compare_exchange_weak(&ticket->state, &state, state | TICKET_CANCELED));
+}
+
+/**
+ *  @details    @c lo から @c hi まで (両端を含む) の識別子の予約中のタスクをまとめて削除する.
+ *              識別子は予約順に大きくなるため, 連続して予約したタスクを指定できる.
+ *              ただし世代が一巡すると識別子は小さな値に戻るため, 一巡をまたいで
+ *              予約したタスクは 1 つの範囲で指定できない.
+ *              範囲内の世代ごとに, 世代から引ける表でチケットを確認するため,
+ *              範囲の広さに比例した時間で完了する. 範囲の世代の数が表の大きさ以上の場合や,
+ *              表の同じ位置を後の世代に譲った予約中のタスクがある場合は,
+ *              チケットをすべて走査するため, Task Queue の容量に比例した時間がかかる.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [in]        lo      削除対象の先頭のタスク識別子.
+ *  @param      [in]        hi      削除対象の末尾のタスク識別子.
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+int AntTQ_CancelRange(struct TaskQueue *self, TaskId lo, TaskId hi)
+{
+    if ((self == NULL) || (lo < 0) || (hi < lo)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* 表を引いた後に displaced を確認するため, 走査中に表の要素を譲ったチケットも見逃さない. */
+    uint64_t first = IdGeneration(self, lo);
+    uint64_t last = IdGeneration(self, hi);
+    uint64_t mask = (UINT64_C(1) << self->slot_bits) - 1;
+    if ((last - first) < mask) {
+        for (uint64_t generation = first; generation <= last; generation += 1) {
+            uint32_t issued = atomic_load(&self->issued[generation & mask]);
+            if (issued != 0) {
+                CancelInRange(self, issued - 1, lo, hi);
+            }
+        }
+        if (atomic_load(&self->displaced) == 0) {
+            return 0;
+        }
+    }
+
+    size_t num_of_classes = atomic_load_explicit(&self->num_of_classes, memory_order_acquire);
+    for (uint32_t book = 0; book <= num_of_classes; book += 1) {
+        uint32_t base = book << self->slot_bits;
+        for (size_t i = 0; i < BookOf(self, base)->tickets.capacity; i += 1) {
+            CancelInRange(self, base | i, lo, hi);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *  @details    @c tag が付けられた未実行のタスクをすべて削除する.
+ *              タグの世代を進めるだけのため, タスク数によらず一定時間で完了する.
+ *              呼び出し後に予約したタスクは削除されない.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [in]        tag     削除対象のタグ. 1 以上である必要がある.
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+int AntTQ_CancelTag(struct TaskQueue *self, unsigned int tag)
+{
+    if ((self == NULL) || (tag == 0) || (LIMIT_TAGS <= tag)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    atomic_fetch_add_explicit(&self->generations[tag], 1, memory_order_relaxed);
+
+    return 0;
+}
+
+/**
+ *  @details    タスク引数スラブから @c size バイトの領域を確保する.
+ *              確保した領域をタスクの引数 (@ref TaskItem::arg) として予約すると,
+ *              タスクの最終状態 (TS_SUCCESS, TS_FAIL, TS_EXPIRED, TS_DROPPED) の通知後,
+ *              またはタスクの取り消し時に自動で解放される.
+ *              1 つの領域を複数のタスクの引数にしないこと.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [in]        size    確保するバイト数.
+ *  @return     成功時は, 確保した領域のポインタが返る.
+ *              失敗時は, NULL が返り, errno が適切に設定される.
+ *              スラブが空の場合は, errno に ENOMEM が設定される.
+ */
+void *AntTQ_AllocArg(struct TaskQueue *self, size_t size)
+{
+    if ((self == NULL) || (self->arg_memory == NULL) || (size == 0)
+        || (((size_t)ARG_MIN_BYTES << (ARG_SIZE_CLASSES - 1)) < size)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t i = 0;
+    while (((size_t)ARG_MIN_BYTES << i) < size) {
+        i += 1;
+    }
+    return MemoryPool_Alloc(&self->args[i]);
+}
+
+/**
+ *  @details    AntTQ_AllocArg() で確保した領域を解放する.
+ *              予約に失敗した場合など, タスクに渡さなかった領域の解放に用いる.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [in]        arg     解放する領域.
+ */
+void AntTQ_FreeArg(struct TaskQueue *self, void *arg)
+{
+    if (self != NULL) {
+        ReleaseArg(self, arg);
+    }
+}
+
+/**
+ *  @details    実行中の Worker の WorkerInit() が返したデータを取得する.
+ *
+ *  @return     成功時は, Worker 固有のデータが返る.
+ *              Worker 以外から呼び出した場合は, NULL が返り, errno に EPERM が設定される.
+ */
+void *AntTQ_WorkerLocal(void)
+{
+    if (current_worker == NULL) {
+        errno = EPERM;
+        return NULL;
+    }
+
+    return current_worker->local;
+}
+
+/**
+ *  @details    実行中の Worker の作業領域から @c size バイトを確保する.
+ *              確保した領域は実行中のタスクの完了後にまとめて解放されるため,
+ *              個別に解放する必要はない. タスクをまたいで保持しないこと.
+ *
+ *  @param      [in]    size    確保するバイト数.
+ *  @return     成功時は, 16 バイト境界に整列した領域のポインタが返る.
+ *              失敗時は, NULL が返り, errno が適切に設定される.
+ *              Worker 以外から呼び出した場合は errno に EPERM,
+ *              作業領域が不足する場合は errno に ENOMEM が設定される.
+ */
+void *AntTQ_WorkerScratch(size_t size)
+{
+    struct WorkerContext *worker = current_worker;
+    if (worker == NULL) {
+        errno = EPERM;
+        return NULL;
+    }
+
+    size_t offset = (worker->used + 15) & ~(size_t)15;
+    if ((worker->scratch == NULL) || (worker->pool->scratch_bytes < offset)
+        || ((worker->pool->scratch_bytes - offset) < size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    worker->used = offset + size;
+
+    return worker->scratch + offset;
+}
+
+/**
+ *  @details    実行中のタスクの結果を設定する.
+ *              設定した結果は, 完了リングに記録されるタスク状態とともに
+ *              AntTQ_Harvest() で取得できる. タスクの中から呼び出すこと.
+ *
+ *  @param      [in]    result  タスクの結果.
+ *  @return     成功時は, 0 が返る.
+ *              タスクの外から呼び出した場合は, -1 が返り, errno に EPERM が設定される.
+ */
+int AntTQ_SetResult(intptr_t result)
+{
+    if (task_result == NULL) {
+        errno = EPERM;
+        return -1;
+    }
+
+    *task_result = result;
+
+    return 0;
+}
+
+/**
+ *  @details    完了リングに記録されたタスク状態を取得する.
+ *              取得は Task Queue の所有者スレッド 1 つから行うこと.
+ *              記録されるタスク状態は, @ref TaskQueueAttr::completion_events で指定する.
+ *              記録がなくてもブロックしない.
+ *              AntTQ_GetCompletionFd() の通知はここで解除され, @c count を超える
+ *              記録が残っている場合は再び通知される.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [out]       out     取得したタスク状態の格納先.
+ *  @param      [in]        count   @c out に格納できる数.
+ *  @return     成功時は, 取得した数が返る. 記録がない場合は 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+ssize_t AntTQ_Harvest(struct TaskQueue *self, struct TaskCompletion *out, size_t count)
+{
+    if ((self == NULL) || (self->completion_memory == NULL) || ((out == NULL) && (count > 0))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* 取り出しより先に通知を解除するため, 取り出し後の追加は必ず再通知される. */
+    eventfd_t value;
+    eventfd_read(self->completion_fd, &value);
+
+    size_t harvested = 0;
+    while ((harvested < count) && (Ring_Pop(&self->completions, &out[harvested]) == 0)) {
+        harvested += 1;
+    }
+    if ((harvested == count) && !Ring_IsEmpty(&self->completions)) {
+        eventfd_write(self->completion_fd, 1);
+    }
+
+    return harvested;
+}
+
+/**
+ *  @details    完了リングにタスク状態が記録されたことを通知するファイル記述子を取得する.
+ *              ファイル記述子は eventfd であり, 完了リングが空から非空になった時に
+ *              読み込み可能になるため, epoll などのイベントループに登録できる.
+ *              読み込み可能になった後は AntTQ_Harvest() で記録を取得すること.
+ *              ファイル記述子は AntTQ_Term() で閉じられる.
+ *
+ *  @param      [in]    self    Task Queue オブジェクト.
+ *  @return     成功時は, ファイル記述子が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              完了リングを使用しない場合は, errno に EINVAL が設定される.
+ */
+int AntTQ_GetCompletionFd(struct TaskQueue *self)
+{
+    if ((self == NULL) || (self->completion_fd < 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return self->completion_fd;
+}
+
+/**
+ *  @details    完了リングが満杯のため記録できなかったタスク状態の数を取得する.
  *
- *  @param      [in,out]    self    Task Queue オブジェクト.
- *  @return     タスクの総数が返る.
- *  @pre        @c self の非 NULL は呼び出し側で保証する.
- *  @warning    変数がオーバーフローした場合は 0 に戻る.
+ *  @param      [in]    self    Task Queue オブジェクト.
+ *  @return     成功時は, 記録できなかった数が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
  */
-static uint32_t IncrementTotalTasks(struct TaskQueue *self)
+ssize_t AntTQ_CompletionOverflow(struct TaskQueue *self)
 {
-    return __atomic_add_fetch(&self->total_tasks, 1, __ATOMIC_SEQ_CST);
+    if (self == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return atomic_load_explicit(&self->overflow, memory_order_relaxed);
 }
 
 /**
- *  タスク実行ワーカー.
- *
- *  キューからタスクを取り出し, 実行する.
- *  タスクが失敗した場合は, 指定に従いリトライを行う.
- *  @c callback が指定されており, かつ callback が false を返した場合は,
- *  処理を中断する.
+ *  @details    流量制限クラスを作成する.
+ *              クラスに属するタスク (@ref TaskItem::rate_class) は, 毎秒 @c rate 件,
+ *              最大 @c burst 件までの連続実行に制限される.
+ *              制限を超えたタスクは Worker を占有せずに保留され, 他のタスクは
+ *              保留中のタスクを追い越して実行される.
+ *              クラスは保留できるタスクの分のチケットと付加情報を別に確保するため,
+ *              保留中のタスクが他のタスクの予約を妨げることはない.
  *
- *  @param  [in]    arg タスク固有引数.
- *  @pre    @c arg の非 NULL は呼び出し側で保証すること.
+ *  @param      [in,out]    self        Task Queue オブジェクト.
+ *  @param      [in]        name        クラス名.
+ *  @param      [in]        rate        毎秒の実行件数.
+ *  @param      [in]        burst       連続して実行できる件数.
+ *  @param      [in]        capacity    保留できるタスクの数. Task Queue の容量以下である必要がある.
+ *  @return     成功時は, 1 以上のクラス識別子が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
  */
-static void *Worker(void *arg)
+int AntTQ_RateClassCreate(struct TaskQueue *self, const char *name, unsigned int rate,
+                          unsigned int burst, size_t capacity)
 {
-    struct TaskQueue *owner = (struct TaskQueue *)arg;
+    if ((self == NULL) || (name == NULL) || (RATE_CLASS_NAME_BYTES <= strlen(name))
+        || (rate == 0) || (burst == 0) || (capacity == 0)
+        || ((self->admission_limit + self->headroom) < capacity)) {
+        errno = EINVAL;
+        return -1;
+    }
 
-    while (true) {
-        pthread_testcancel();
+    struct Queue que;
+    ssize_t pool_size = Queue_ComputeSize(&que, sizeof(struct TaskItemCargo), capacity);
+    if (pool_size < 0) {
+        return -1;
+    }
+    pool_size = (pool_size + 7) & ~7;
+    /* 保留中のタスクに加えて, 実行中のタスクの分を確保する.
+     * 枯渇した場合は Task Queue 本体の領域を使用する.
+     */
+    struct TicketBook book;
+    ssize_t extension_size = MemoryPool_ComputeSize(&book.extensions, sizeof(struct TaskExtension),
+                                                    capacity + LIMIT_PARTICIPANTS);
+    ssize_t ticket_size = MemoryPool_ComputeSize(&book.tickets, sizeof(struct TaskTicket),
+                                                 capacity + LIMIT_PARTICIPANTS);
+    if ((extension_size < 0) || (ticket_size < 0)) {
+        return -1;
+    }
+    struct RateClass *klass = (struct RateClass *)malloc(sizeof(*klass) + pool_size
+                                                         + extension_size + ticket_size);
+    if (klass == NULL) {
+        return -1;
+    }
+    *klass = (struct RateClass){
+        .interval_ns = 1000000000 / rate,
+        .tolerance_ns = (uint64_t)(burst - 1) * (1000000000 / rate),
+        .tat = 0,
+        .pending = 0,
+        .que = que,
+        .book = book,
+    };
+    strcpy(klass->name, name);
+    Queue_Bind(&klass->que, klass->reserved);
+    MemoryPool_Bind(&klass->book.extensions, klass->reserved + pool_size);
+    /* AntTQ_CancelRange() が未使用のチケットを走査できるよう, 状態を 0 にしておく. */
+    memset(klass->reserved + pool_size + extension_size, 0, ticket_size);
+    MemoryPool_Bind(&klass->book.tickets, klass->reserved + pool_size + extension_size);
 
-        struct TaskItemCargo cargo;
-        lock (&owner->mutex) {
-            while (atomic_load(&owner->suspended) || (Queue_Dequeue(&owner->que, &cargo) != 0)) {
-                pthread_cond_wait(&owner->inqueue, &owner->mutex);
-            }
-        }
+    int ret = -1;
+    pthread_spin_lock(&self->pool->sched);
+    if (self->num_of_classes < LIMIT_RATE_CLASSES) {
+        self->classes[self->num_of_classes] = klass;
+        atomic_store_explicit(&self->num_of_classes, self->num_of_classes + 1,
+                              memory_order_release);
+        ret = self->num_of_classes;
+    }
+    pthread_spin_unlock(&self->pool->sched);
 
-        do {
-            TaskId id = cargo.id;
-            struct TaskItem *item = &cargo.item;
+    if (ret < 0) {
+        free(klass);
+        errno = ENOSPC;
+    }
+    return ret;
+}
 
-            if (bitflag_get(owner->canceled, id)) {
-                continue;
-            }
+/**
+ *  @details    名前から流量制限クラスを検索する.
+ *
+ *  @param      [in]    self    Task Queue オブジェクト.
+ *  @param      [in]    name    クラス名.
+ *  @return     成功時は, クラス識別子が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+int AntTQ_RateClassFind(struct TaskQueue *self, const char *name)
+{
+    if ((self == NULL) || (name == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
 
-            if (!item->Callback(id, TS_ACK, item->arg)) {
-                continue;
-            }
-            bool result = item->Task(id, item->arg);
-            if (!result && (item->retry > 0)) {
-                if (!item->Callback(id, TS_RETRY, item->arg)) {
-                    continue;
-                }
-                item->retry -= 1;
-                if (Queue_Enqueue(&owner->que, &cargo) != 0) {
-                    item->Callback(id, TS_FAIL, item->arg);
-                }
-            } else {
-                item->Callback(id, (result ? TS_SUCCESS : TS_FAIL), item->arg);
-            }
-        } while (Queue_Dequeue(&owner->que, &cargo) == 0);
+    size_t num_of_classes = atomic_load_explicit(&self->num_of_classes, memory_order_acquire);
+    for (size_t i = 0; i < num_of_classes; i += 1) {
+        if (strcmp(self->classes[i]->name, name) == 0) {
+            return i + 1;
+        }
     }
 
-    return NULL;
+    errno = ENOENT;
+    return -1;
 }
 
 /**
- *  @details    指定の容量, ワーカー数で Task Queue を生成する.
+ *  @details    @c self にタスクを予約するタスクグループを生成する.
  *
- *  @param      [in]    capacity    キューの容量.
- *  @param      [in]    workers     ワーカー数.
- *  @return     成功時は, 確保および初期化したオブジェクトのポインタを返る.
+ *  @param      [in]    self    Task Queue オブジェクト.
+ *  @return     成功時は, 確保および初期化したタスクグループのポインタが返る.
  *              失敗時は, NULL が返り, errno が適切に設定される.
  */
-struct TaskQueue *AntTQ_Init(size_t capacity, size_t workers)
+struct TaskGroup *AntTQ_GroupCreate(struct TaskQueue *self)
 {
-    if ((capacity == 0) || (workers == 0) || (INT16_MAX < capacity) || (LIMIT_WORKERS < workers)) {
+    if (self == NULL) {
         errno = EINVAL;
         return NULL;
     }
 
-    struct Queue que;
-    ssize_t pool_size = Queue_ComputeSize(&que, sizeof(struct TaskItemCargo), capacity);
-    if (pool_size < 0) {
+    struct TaskGroup *group = (struct TaskGroup *)malloc(sizeof(*group));
+    if (group == NULL) {
         return NULL;
     }
+    GroupSetup(group, self);
 
-    struct TaskQueue *self = (struct TaskQueue *)malloc(sizeof(*self) + pool_size);
-    if (self == NULL) {
-        return NULL;
-    }
-    *self = (struct TaskQueue){
-        .num_of_workers = workers,
-        .total_tasks = 0,
-        .mutex = PTHREAD_MUTEX_INITIALIZER,
-        .inqueue = PTHREAD_COND_INITIALIZER,
-        .suspended = true,
-        .canceled = BITFLAG_INITIALIZER,
-        .que = que,
-    };
-    Queue_Bind(&self->que, self->reserved);
+    return group;
+}
 
-    for (size_t i = 0; i < self->num_of_workers; i += 1) {
-        int ret = pthread_create(&self->thrd_ids[i], NULL, Worker, self);
-        if (ret != 0) {
-            for (int j = i; j >= 0; j -= 1) {
-                pthread_cancel(self->thrd_ids[j]);
-            }
-            for (int j = i; j >= 0; j -= 1) {
-                pthread_join(self->thrd_ids[j], NULL);
-            }
-            free(self);
-            errno = ret;
-            return NULL;
-        }
+/**
+ *  @details    @c group を解放する.
+ *              未完了のタスクが残っている場合は, AntTQ_GroupWait() で
+ *              完了を待ってから解放すること.
+ *
+ *  @param      [in,out]    group   タスクグループ.
+ */
+void AntTQ_GroupDestroy(struct TaskGroup *group)
+{
+    free(group);
+}
+
+/**
+ *  @details    @c group に所属するタスクを予約する.
+ *
+ *  @param      [in,out]    group   タスクグループ.
+ *  @param      [in]        item    予約するタスク情報.
+ *  @return     成功時は, 予約したタスクの識別子が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              グループが取り消し済みの場合は, errno に ECANCELED が設定される.
+ */
+TaskId AntTQ_GroupEnqueue(struct TaskGroup *group, struct TaskItem *item)
+{
+    if ((group == NULL) || (item == NULL) || (item->Task == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (atomic_load(&group->canceled)) {
+        errno = ECANCELED;
+        return -1;
     }
 
-    return self;
+    return EnqueueItem(group->owner, item, group);
 }
 
 /**
- *  @details    @c self を解放する.
- *              @c self は AntTQ_Init() の戻り値である必要がある.
+ *  @details    @c group に所属するタスクを, Worker プールのすべての Worker で
+ *              1 回ずつ実行する. AntTQ_GroupWait() ですべての Worker の実行完了を待てる.
+ *              制約は AntTQ_Broadcast() と同じである.
  *
- *  @param      [in,out]    self  Task Queue オブジェクト.
+ *  @param      [in,out]    group   タスクグループ.
+ *  @param      [in]        item    実行するタスク情報.
+ *  @return     成功時は, タスクの識別子が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ *              グループが取り消し済みの場合は, errno に ECANCELED が設定される.
  */
-void AntTQ_Term(struct TaskQueue *self)
+TaskId AntTQ_GroupBroadcast(struct TaskGroup *group, struct TaskItem *item)
 {
-    if (self != NULL) {
-        for (size_t i = 0; i < self->num_of_workers; i += 1) {
-            pthread_cancel(self->thrd_ids[i]);
-        }
-        for (size_t i = 0; i < self->num_of_workers; i += 1) {
-            pthread_join(self->thrd_ids[i], NULL);
-        }
-        free(self);
+    if ((group == NULL) || (item == NULL) || (item->Task == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (atomic_load(&group->canceled)) {
+        errno = ECANCELED;
+        return -1;
     }
+
+    return BroadcastItem(group->owner, item, group);
 }
 
-int AntTQ_Start(struct TaskQueue *self)
+/**
+ *  @details    @c group に所属するタスクがすべて完了するまで待つ.
+ *              取り消されたタスクは, キューから取り出された時点で完了とみなす.
+ *
+ *  @param      [in,out]    group       タスクグループ.
+ *  @param      [in]        timeout_ms  タイムアウト (ミリ秒). 負数の場合は無期限.
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+int AntTQ_GroupWait(struct TaskGroup *group, int timeout_ms)
 {
-    if (self == NULL) {
+    if (group == NULL) {
         errno = EINVAL;
         return -1;
     }
 
-    atomic_store(&self->suspended,  false);
-    lock (&self->mutex) {
-        pthread_cond_broadcast(&self->inqueue);
+    return GroupWaitFor(group, timeout_ms);
+}
+
+/**
+ *  @details    @c group に所属するタスクがすべて完了するまで, 呼び出し元スレッドで
+ *              キューのタスクを実行しながら待つ.
+ *              タスクは Worker と同じ経路 (コールバック, リトライを含む) で実行される.
+ *              タスクの中から呼び出しても, Worker がすべて塞がっていることによる
+ *              デッドロックは起きない.
+ *
+ *  @param      [in,out]    group       タスクグループ.
+ *  @param      [in]        timeout_ms  タイムアウト (ミリ秒). 負数の場合は無期限.
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+int AntTQ_GroupHelpWait(struct TaskGroup *group, int timeout_ms)
+{
+    if (group == NULL) {
+        errno = EINVAL;
+        return -1;
     }
 
-    return 0;
+    return GroupHelpWaitFor(group, timeout_ms);
 }
 
-int AntTQ_Stop(struct TaskQueue *self)
+/**
+ *  @details    @c group に所属する未実行のタスクをすべて取り消す.
+ *              取り消しは O(1) で行われ, 各タスクはキューから取り出された
+ *              時点で実行されずに破棄される. 実行中のタスクは中断されない.
+ *              取り消し後のグループにはタスクを予約できない.
+ *
+ *  @param      [in,out]    group   タスクグループ.
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+int AntTQ_GroupCancel(struct TaskGroup *group)
 {
-    if (self == NULL) {
+    if (group == NULL) {
         errno = EINVAL;
         return -1;
     }
 
-    atomic_store(&self->suspended, true);
+    atomic_store(&group->canceled, true);
 
     return 0;
 }
 
 /**
- *  @details    指定のタスクを実行予約する.
+ *  開始チャンクと終了チャンクから担当範囲を生成する.
+ */
+static inline uint64_t MakeSpan(uint32_t begin, uint32_t end)
+{
+    return ((uint64_t)begin << 32) | end;
+}
+
+static inline uint32_t SpanBegin(uint64_t span)
+{
+    return (uint32_t)(span >> 32);
+}
+
+static inline uint32_t SpanEnd(uint64_t span)
+{
+    return (uint32_t)span;
+}
+
+/**
+ *  他の参加者の担当範囲を半分奪い, そのうち先頭のチャンクを取り出す.
  *
- *  @param      [in,out]    self    Task Queue オブジェクト.
- *  @param      [in]        item    予約するタスク情報.
- *  @return     成功時は, 予約したタスクの識別子が返る.
- *              失敗時は, -1 が返り, errno が適切に設定される.
+ *  残りが最も多い参加者から後半を奪うことで, 範囲は需要に応じて
+ *  再帰的に二分割される.
+ *
+ *  @param  [in,out]    job     並列ループ.
+ *  @param  [in]        slot    自身の参加者番号.
+ *  @param  [out]       chunk   取り出したチャンク.
+ *  @return 取り出せた場合は true が返る.
+ *          すべての範囲が取り出し済みの場合は false が返る.
  */
-TaskId AntTQ_Enqueue(struct TaskQueue *self, struct TaskItem *item)
+static bool StealChunk(struct ParallelJob *job, size_t slot, uint32_t *chunk)
 {
-    if ((self == NULL) || (item == NULL) || (item->Task == NULL)) {
-        errno = EINVAL;
-        return -1;
+    while (true) {
+        size_t victim = slot;
+        uint32_t most = 0;
+        for (size_t i = 0; i < job->participants; i += 1) {
+            uint64_t span = atomic_load(&job->slots[i].span);
+            if ((i != slot) && (most < (SpanEnd(span) - SpanBegin(span)))) {
+                most = SpanEnd(span) - SpanBegin(span);
+                victim = i;
+            }
+        }
+        if (victim == slot) {
+            return false;
+        }
+
+        uint64_t span = atomic_load(&job->slots[victim].span);
+        uint32_t begin = SpanBegin(span), end = SpanEnd(span);
+        if (end <= begin) {
+            continue;
+        }
+        uint32_t mid = begin + ((end - begin) / 2);
+        if (atomic_compare_exchange_weak(&job->slots[victim].span, &span, MakeSpan(begin, mid))) {
+            *chunk = mid;
+            atomic_store(&job->slots[slot].span, MakeSpan(mid + 1, end));
+            return true;
+        }
     }
+}
 
-    /* ワーカーの処理をシンプルにするため, コールバックが設定されていない場合は
-     * ダミーのコールバックを設定する.
-     */
-    if (item->Callback == NULL) {
-        item->Callback = NullCallback;
+/**
+ *  自身の担当範囲から先頭のチャンクを取り出す.
+ *
+ *  担当範囲が空の場合は, 他の参加者から奪う.
+ *
+ *  @param  [in,out]    job     並列ループ.
+ *  @param  [in]        slot    自身の参加者番号.
+ *  @param  [out]       chunk   取り出したチャンク.
+ *  @return 取り出せた場合は true が返る.
+ */
+static bool TakeChunk(struct ParallelJob *job, size_t slot, uint32_t *chunk)
+{
+    uint64_t span = atomic_load(&job->slots[slot].span);
+    while (SpanBegin(span) < SpanEnd(span)) {
+        if (atomic_compare_exchange_weak(&job->slots[slot].span, &span,
+                                         MakeSpan(SpanBegin(span) + 1, SpanEnd(span)))) {
+            *chunk = SpanBegin(span);
+            return true;
+        }
     }
 
-    struct TaskItemCargo cargo = {
-        .id = IncrementTotalTasks(self) & INT16_MAX,
-        .item = *item,
-    };
-    bitflag_unset(self->canceled, cargo.id);
-    if (Queue_Enqueue(&self->que, &cargo) != 0) {
+    return StealChunk(job, slot, chunk);
+}
+
+/**
+ *  並列ループの参加者として, チャンクがなくなるまで処理する.
+ *
+ *  @param  [in,out]    job     並列ループ.
+ *  @param  [in]        slot    自身の参加者番号.
+ */
+static void ParallelRun(struct ParallelJob *job, size_t slot)
+{
+    uint8_t acc[(job->size == 0) ? 1 : job->size];
+    void *partial = acc;
+    bool worked = false;
+
+    if (job->size != 0) {
+        memcpy(partial, job->identity, job->size);
+    }
+
+    uint32_t chunk;
+    while (TakeChunk(job, slot, &chunk)) {
+        size_t begin = job->begin + ((size_t)chunk * job->grain);
+        size_t end = ((job->end - begin) < job->grain) ? job->end : (begin + job->grain);
+        if (job->Reduce != NULL) {
+            job->Reduce(begin, end, partial, job->ctx);
+        } else {
+            job->For(begin, end, job->ctx);
+        }
+        worked = true;
+    }
+
+    if ((job->size != 0) && worked) {
+        synchronized (&job->mutex) {
+            job->Join(job->result, partial, job->ctx);
+        }
+    }
+}
+
+/**
+ *  並列ループのヘルパータスク.
+ *
+ *  @param  [in]    id  タスク識別子.
+ *  @param  [in]    arg 並列ループ.
+ *  @return true 固定.
+ */
+static bool ParallelHelper(TaskId id MAYBE_UNUSED, void *arg)
+{
+    struct ParallelJob *job = (struct ParallelJob *)arg;
+    size_t slot = atomic_fetch_add(&job->joined, 1) + 1;
+    if (slot < job->participants) {
+        ParallelRun(job, slot);
+    }
+
+    return true;
+}
+
+/**
+ *  並列ループを実行する.
+ *
+ *  範囲をチャンクに分けて参加者に均等に割り当て, Worker にヘルパータスクを
+ *  予約したうえで呼び出し元スレッドも参加者として処理する.
+ *  処理を終えた参加者は, 残りの多い参加者から範囲を半分ずつ奪う.
+ *
+ *  @param  [in,out]    self    Task Queue オブジェクト.
+ *  @param  [in,out]    job     並列ループ. 範囲, 本体, 粒度を設定しておくこと.
+ */
+static void ParallelExecute(struct TaskQueue *self, struct ParallelJob *job)
+{
+    size_t count = job->end - job->begin;
+    size_t helpers = atomic_load(&self->suspended) ? 0 : self->pool->num_of_workers;
+    if (job->grain == 0) {
+        job->grain = count / ((helpers + 1) * CHUNKS_PER_PARTICIPANT);
+    }
+    /* チャンク番号は 32 bit で扱うため, 必要に応じて粒度を大きくする. */
+    if (job->grain < (((count - 1) / UINT32_MAX) + 1)) {
+        job->grain = ((count - 1) / UINT32_MAX) + 1;
+    }
+    size_t chunks = ((count - 1) / job->grain) + 1;
+    if ((chunks - 1) < helpers) {
+        helpers = chunks - 1;
+    }
+
+    job->participants = helpers + 1;
+    job->joined = 0;
+    job->mutex = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+    GroupSetup(&job->group, self);
+    for (size_t i = 0; i < job->participants; i += 1) {
+        job->slots[i].span = MakeSpan((chunks * i) / job->participants,
+                                      (chunks * (i + 1)) / job->participants);
+    }
+
+    struct TaskItem item = TASK_ITEM_INITIALIZER;
+    item.Task = ParallelHelper;
+    item.arg = job;
+    for (size_t i = 0; i < helpers; i += 1) {
+        if (EnqueueItem(self, &item, &job->group) < 0) {
+            break;
+        }
+    }
+
+    ParallelRun(job, 0);
+
+    /* 未着手のヘルパーは担当範囲を奪われているため, 取り消してから完了を待つ.
+     * Worker が塞がっていても入れ子の並列ループが停滞しないよう, 待つ間は
+     * キューのタスクを実行する.
+     */
+    atomic_store(&job->group.canceled, true);
+    GroupHelpWaitFor(&job->group, -1);
+}
+
+/**
+ *  @details    [@c begin, @c end) の範囲を分割し, @c fn を並列に実行する.
+ *              呼び出し元スレッドも処理に参加し, すべての範囲の処理が
+ *              完了してから戻る.
+ *              範囲は Worker の空き具合に応じて適応的に二分割される.
+ *
+ *  @param      [in,out]    self    Task Queue オブジェクト.
+ *  @param      [in]        begin   ループの開始値.
+ *  @param      [in]        end     ループの終了値 (この値を含まない).
+ *  @param      [in]        grain   分割の最小単位となる要素数. 0 の場合は自動で決定する.
+ *  @param      [in]        fn      [begin, end) の部分範囲を処理する関数.
+ *  @param      [in]        ctx     @c fn に渡される引数.
+ *  @return     成功時は, 0 が返る.
+ *              失敗時は, -1 が返り, errno が適切に設定される.
+ */
+int AntTQ_ParallelFor(struct TaskQueue *self, size_t begin, size_t end, size_t grain,
+                      void (*fn)(size_t begin, size_t end, void *ctx), void *ctx)
+{
+    if ((self == NULL) || (end < begin) || (fn == NULL)) {
+        errno = EINVAL;
         return -1;
     }
-    lock (&self->mutex) {
-        pthread_cond_signal(&self->inqueue);
+    if (begin == end) {
+        return 0;
     }
 
-    /* ワーカーのスループットを良くするため, CPU を明け渡す. */
-    sched_yield();
+    struct ParallelJob job = {
+        .begin = begin,
+        .end = end,
+        .grain = grain,
+        .For = fn,
+        .ctx = ctx,
+    };
+    ParallelExecute(self, &job);
 
-    return cargo.id;
+    return 0;
 }
 
 /**
- *  @details    @c id のタスクをキューから削除する.
- *              @c id がすでにキューから取り出されている場合は削除できない.
+ *  @details    [@c begin, @c end) の範囲を分割して並列に集約する.
+ *              参加者ごとに @c result の初期値 (単位元) を複製した部分集約値を持ち,
+ *              @c fn で部分範囲を集約した後, @c join で @c result に結合する.
+ *              結合の順序は不定のため, @c join は結合則と交換則を満たすこと.
+ *              部分集約値はスタック上に置かれるため, @c size は小さく保つこと.
  *
  *  @param      [in,out]    self    Task Queue オブジェクト.
- *  @param      [in]        id  削除対象のタスク識別子.
+ *  @param      [in]        begin   ループの開始値.
+ *  @param      [in]        end     ループの終了値 (この値を含まない).
+ *  @param      [in]        grain   分割の最小単位となる要素数. 0 の場合は自動で決定する.
+ *  @param      [in]        fn      [begin, end) の部分範囲を @c acc に集約する関数.
+ *  @param      [in]        join    @c other を @c acc に結合する関数.
+ *  @param      [in,out]    result  入力時は単位元, 出力時は集約結果.
+ *  @param      [in]        size    集約値のバイト数.
+ *  @param      [in]        ctx     @c fn, @c join に渡される引数.
  *  @return     成功時は, 0 が返る.
  *              失敗時は, -1 が返り, errno が適切に設定される.
  */
-int AntTQ_Cancel(struct TaskQueue *self, TaskId id)
+int AntTQ_ParallelReduce(struct TaskQueue *self, size_t begin, size_t end, size_t grain,
+                         void (*fn)(size_t begin, size_t end, void *acc, void *ctx),
+                         void (*join)(void *acc, const void *other, void *ctx),
+                         void *result, size_t size, void *ctx)
 {
-    if ((self == NULL) || (id < 0)) {
+    if ((self == NULL) || (end < begin) || (fn == NULL) || (join == NULL)
+        || (result == NULL) || (size == 0)) {
         errno = EINVAL;
         return -1;
     }
+    if (begin == end) {
+        return 0;
+    }
 
-    bitflag_set(self->canceled, id);
+    uint8_t identity[size];
+    memcpy(identity, result, size);
+    struct ParallelJob job = {
+        .begin = begin,
+        .end = end,
+        .grain = grain,
+        .Reduce = fn,
+        .Join = join,
+        .ctx = ctx,
+        .identity = identity,
+        .result = result,
+        .size = size,
+    };
+    ParallelExecute(self, &job);
 
     return 0;
 }
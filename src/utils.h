@@ -10,6 +10,8 @@
 #ifndef __ANTTQ_UTILS_H__
 #define __ANTTQ_UTILS_H__
 
+#include <pthread.h>
+
 /** @addtogroup cat_utils ユーティリティ
  *  便利な機能を提供するモジュール.
  *  @{
@@ -17,6 +19,17 @@
 
 #define MAYBE_UNUSED __attribute__((unused))
 
+/**
+ *  スピン待ち中であることを CPU に通知するマクロ.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__arm__) || defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
 /**
  *  文字列結合マクロ.
  */
@@ -28,46 +41,42 @@
 #define macro_cat(a, b) cat(a, b)
 
 /**
- *  汎用排他取得マクロ.
- */
-#define generic_lock(obj) \
-    _Generic((obj),       \
-             pthread_mutex_t *: pthread_mutex_lock)(obj)
-
-/**
- *  汎用排他解放マクロ.
- */
-#define generic_unlock(obj) \
-    _Generic((obj),         \
-             pthread_mutex_t *: pthread_mutex_unlock)(obj)
-
-/**
- *  キャンセル可能な汎用排他取得マクロ.
+ *  排他区間に入る.
+ *
+ *  @param  [in,out]    mutex   排他オブジェクト.
+ *  @return @c mutex が返る.
  */
-#define generic_cancellable_lock(obj)                                                        \
-    _Generic((obj),                                                                          \
-             pthread_mutex_t *: pthread_mutex_lock)(obj);                                    \
-    void macro_cat(__cleaner__, __LINE__)(void *macro_cat(__arg__, __LINE__) MAYBE_UNUSED) { \
-        _Generic((obj),                                                                      \
-                 pthread_mutex_t *: pthread_mutex_unlock)(obj);                              \
-    }                                                                                        \
-    pthread_cleanup_push(macro_cat(__cleaner__, __LINE__), (obj))
+static inline pthread_mutex_t *CriticalEnter(pthread_mutex_t *mutex)
+{
+    pthread_mutex_lock(mutex);
+    return mutex;
+}
 
 /**
- *  キャンセル可能な汎用排他解放マクロ.
+ *  排他区間を出る.
+ *
+ *  排他区間の変数の解放時にも呼び出されるため, 出た後は @c *held を NULL にする.
+ *
+ *  @param  [in,out]    held    取得中の排他オブジェクト. NULL の場合は何もしない.
  */
-#define generic_cancellable_unlock(obj)                     \
-    _Generic((obj),                                         \
-             pthread_mutex_t *: pthread_mutex_unlock)(obj); \
-    pthread_cleanup_pop(0)
+static inline void CriticalLeave(pthread_mutex_t **held)
+{
+    if (*held != NULL) {
+        pthread_mutex_unlock(*held);
+        *held = NULL;
+    }
+}
 
 /**
  *  同期ブロックマクロ.
  *
  *  同期オブジェクトを利用して, 続くブロックを排他制御する.
- *  複数の処理を行う場合は @ref lock を使用すること.
+ *  ブロック内にスレッドの取り消しポイントがある場合は @ref lock を使用すること.
  *
  *  @warning    ブロック内で, return, break, continue, goto はしないこと.
+ *              return, break, goto で抜けると排他オブジェクトが解放されない.
+ *              また, ブロックはマクロの for 文であるため, break, continue は
+ *              呼び出し元のループではなく, このブロックにのみ作用する.
  *
  *  @par        使用例
  *              @code
@@ -77,29 +86,24 @@
  *              }
  *              @endcode
  */
-#if !defined(__clang__)
-#define synchronized(obj)                                             \
-    void macro_cat(__caller__, __LINE__)(void (*fn)(void)) {          \
-        generic_lock(obj);                                            \
-        fn();                                                         \
-        generic_unlock(obj);                                          \
-    }                                                                 \
-    auto void macro_cat(__callee__, __LINE__)(void);                  \
-    macro_cat(__caller__, __LINE__)(macro_cat(__callee__, __LINE__)); \
-    void macro_cat(__callee__, __LINE__)(void)
-#else
-#warning 'synchronized' is not supported in clang
-#define synchronized(obj)
-#endif
+#define synchronized(obj)                                                            \
+    for (pthread_mutex_t *macro_cat(__held__, __LINE__) = CriticalEnter(obj);        \
+         macro_cat(__held__, __LINE__) != NULL;                                      \
+         CriticalLeave(&macro_cat(__held__, __LINE__)))
 
 /**
  *  同期ブロックマクロ.
  *
  *  同期オブジェクトを利用して, 続くブロックを排他制御する.
- *  インクリメントのみの場合などは @ref synchronized を使用するほうが
- *  パフォーマンスが良い.
+ *  ブロックを抜ける際に変数の cleanup 属性で解放するため, ブロック内の
+ *  pthread_cond_wait() などでスレッドが取り消された場合も解放される.
+ *  取り消し時の解放には, -fexceptions でコンパイルする必要がある.
+ *  同じ理由で, ブロックから return, goto で抜けた場合も解放される.
  *
- *  @warning    ブロック内で, return, break, continue, goto はしないこと.
+ *  @warning    ブロックはマクロの for 文であるため, ブロック内の break, continue は
+ *              呼び出し元のループではなく, このブロックにのみ作用する.
+ *              排他オブジェクトは解放されるが, 呼び出し元のループは継続する.
+ *              呼び出し元のループを抜けるには, フラグを立ててブロックの後で判定すること.
  *
  *  @par        使用例
  *              @code
@@ -109,20 +113,11 @@
  *              }
  *              @endcode
  */
-#if !defined(__clang__)
-#define lock(obj)                                                     \
-    void macro_cat(__caller__, __LINE__)(void (*fn)(void)) {          \
-        generic_cancellable_lock(obj);                                \
-        fn();                                                         \
-        generic_cancellable_unlock(obj);                              \
-    }                                                                 \
-    auto void macro_cat(__callee__, __LINE__)(void);                  \
-    macro_cat(__caller__, __LINE__)(macro_cat(__callee__, __LINE__)); \
-    void macro_cat(__callee__, __LINE__)(void)
-#else
-#warning 'lock' is not supported in clang
-#define lock(obj)
-#endif
+#define lock(obj)                                                                    \
+    for (pthread_mutex_t *macro_cat(__held__, __LINE__)                              \
+             __attribute__((cleanup(CriticalLeave))) = CriticalEnter(obj);           \
+         macro_cat(__held__, __LINE__) != NULL;                                      \
+         CriticalLeave(&macro_cat(__held__, __LINE__)))
 
 /** @} */
 
@@ -5,8 +5,12 @@
  *  @date   2018-03-18 新規作成.
  */
 
+#include <algorithm>
 #include <atomic>
 #include <vector>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <catch2/catch.hpp>
 
 #include "utils.hpp"
@@ -16,6 +20,12 @@ extern "C" {
 }
 
 #include <cstdio>
+#include <cerrno>
+#include <ctime>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 class BitFlags {
 private:
@@ -67,6 +77,55 @@ SCENARIO("タスクキューが初期化できること", tags("taskq", "init"))
     }
 }
 
+SCENARIO("アイドル戦略を指定して初期化できること", tags("taskq", "init", "idle")) {
+    GIVEN("特になし") {
+        WHEN("不正なアイドル戦略で初期化する") {
+            struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+            attr.idle_policy = IP_LENGTH;
+            struct TaskQueue *tq = AntTQ_InitAttr(1, 1, &attr);
+
+            THEN("初期化に失敗すること") {
+                REQUIRE(tq == NULL);
+                REQUIRE(errno == EINVAL);
+            }
+        }
+
+        WHEN("各アイドル戦略でタスクを断続的に追加する") {
+            auto policy = GENERATE(IP_BALANCED, IP_LATENCY, IP_POWER);
+            struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+            attr.idle_policy = policy;
+            attr.spin_ns = 200000;
+            struct TaskQueue *tq = AntTQ_InitAttr(10, 2, &attr);
+            REQUIRE(tq != NULL);
+            AntTQ_Start(tq);
+
+            std::atomic<int> count{0};
+            auto runner = [&](TaskId, void *) -> bool {
+                count += 1;
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            for (int i = 0; i < 20; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+                if ((i % 5) == 4) {
+                    msleep(2);
+                }
+            }
+
+            THEN("すべてのタスクが呼び出されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                REQUIRE(count == 20);
+            }
+
+            AntTQ_Term(tq);
+        }
+    }
+}
+
 SCENARIO("タスクが処理できること", tags("taskq", "run")) {
     GIVEN("タスクキューを容量 1, ワーカー 1 で初期化する") {
         struct TaskQueue *tq = AntTQ_Init(1, 1);
@@ -598,6 +657,60 @@ SCENARIO("タスク削除できること", tags("taskq", "cancel")) {
     }
 }
 
+SCENARIO("範囲やタグを指定してタスク削除できること", tags("taskq", "cancel")) {
+    GIVEN("停止中のタスクキューを容量 100, ワーカー 1 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(100, 1)};
+
+        std::atomic<int> task_called{0};
+        auto runner = [&](TaskId, void *) -> bool {
+            task_called += 1;
+            return true;
+        };
+        struct TaskItem item{TASK_ITEM_INITIALIZER};
+        item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+
+        WHEN("10 件追加し, 中間の 5 件を範囲で削除する") {
+            std::vector<TaskId> ids;
+            for (int i = 0; i < 10; ++i) {
+                ids.push_back(AntTQ_Enqueue(tq, &item));
+            }
+            REQUIRE(AntTQ_CancelRange(tq, ids[2], ids[6]) == 0);
+            REQUIRE(AntTQ_CancelRange(tq, ids[6], ids[2]) == -1);
+            REQUIRE(errno == EINVAL);
+            AntTQ_Start(tq);
+
+            THEN("範囲外の 5 件のみ処理されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                REQUIRE(task_called == 5);
+            }
+        }
+
+        WHEN("タグ 1 とタグ 2 のタスクを 5 件ずつ追加し, タグ 1 を削除する") {
+            for (int i = 0; i < 10; ++i) {
+                item.tag = (i % 2) + 1;
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            REQUIRE(AntTQ_CancelTag(tq, 1) == 0);
+            REQUIRE(AntTQ_CancelTag(tq, 0) == -1);
+            REQUIRE(errno == EINVAL);
+            item.tag = 1;
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            AntTQ_Start(tq);
+
+            THEN("削除後に追加したものを含めて 6 件処理されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                REQUIRE(task_called == 6);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
 SCENARIO("連続動作確認", tags("taskq", "run")) {
     GIVEN("タスクキューを容量 30000, ワーカー 8 で初期化する") {
         static const size_t capacity{30000};
@@ -640,3 +753,2118 @@ SCENARIO("連続動作確認", tags("taskq", "run")) {
         AntTQ_Term(tq);
     }
 }
+
+SCENARIO("タスクグループの完了を待てること", tags("taskq", "group")) {
+    GIVEN("タスクキューを容量 1000, ワーカー 4 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(1000, 4)};
+        AntTQ_Start(tq);
+        struct TaskGroup *group{AntTQ_GroupCreate(tq)};
+        REQUIRE(group != NULL);
+
+        WHEN("タスクを 500 件グループに追加して完了を待つ") {
+            std::atomic<int> count{0};
+            auto runner = [&](TaskId, void *) -> bool {
+                count += 1;
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            for (int i = 0; i < 500; ++i) {
+                REQUIRE(AntTQ_GroupEnqueue(group, &item) >= 0);
+            }
+
+            THEN("すべてのタスクが完了してから戻ること") {
+                REQUIRE(AntTQ_GroupWait(group, -1) == 0);
+                REQUIRE(count == 500);
+            }
+        }
+
+        AntTQ_GroupDestroy(group);
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("停止中のタスクキューを容量 100, ワーカー 2 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(100, 2)};
+        struct TaskGroup *group{AntTQ_GroupCreate(tq)};
+        REQUIRE(group != NULL);
+
+        std::atomic<int> count{0};
+        auto runner = [&](TaskId, void *) -> bool {
+            count += 1;
+            return true;
+        };
+        struct TaskItem item{TASK_ITEM_INITIALIZER};
+        item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+        for (int i = 0; i < 50; ++i) {
+            REQUIRE(AntTQ_GroupEnqueue(group, &item) >= 0);
+        }
+
+        WHEN("タイムアウトを指定して完了を待つ") {
+            int ret = AntTQ_GroupWait(group, 10);
+
+            THEN("タイムアウトすること") {
+                REQUIRE(ret == -1);
+                REQUIRE(errno == ETIMEDOUT);
+            }
+
+            AntTQ_Start(tq);
+            AntTQ_GroupWait(group, -1);
+        }
+
+        WHEN("グループを取り消してからタスクキューを開始する") {
+            REQUIRE(AntTQ_GroupCancel(group) == 0);
+            AntTQ_Start(tq);
+
+            THEN("タスクが実行されずに完了すること") {
+                REQUIRE(AntTQ_GroupWait(group, -1) == 0);
+                REQUIRE(count == 0);
+                REQUIRE(AntTQ_GroupEnqueue(group, &item) == -1);
+                REQUIRE(errno == ECANCELED);
+            }
+        }
+
+        AntTQ_GroupDestroy(group);
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("範囲を分割して並列に処理できること", tags("taskq", "parallel")) {
+    GIVEN("タスクキューを容量 100, ワーカー 4 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(100, 4)};
+        AntTQ_Start(tq);
+
+        WHEN("100000 要素を粒度指定なしで並列に処理する") {
+            static const size_t width{100000};
+            std::vector<std::atomic<int>> visits(width);
+            auto body = [&](size_t begin, size_t end, void *) {
+                for (size_t i = begin; i < end; i += 1) {
+                    visits[i] += 1;
+                }
+            };
+
+            REQUIRE(AntTQ_ParallelFor(tq, 0, width, 0,
+                                      Lambda::cify<void, size_t, size_t, void *>(body), NULL) == 0);
+
+            THEN("すべての要素がちょうど 1 回処理されること") {
+                bool once = true;
+                for (size_t i = 0; i < width; i += 1) {
+                    if (visits[i] != 1) {
+                        once = false;
+                        break;
+                    }
+                }
+                REQUIRE(once == true);
+            }
+        }
+
+        WHEN("1 から 10000 の総和を粒度 7 で並列に集約する") {
+            auto body = [&](size_t begin, size_t end, void *acc, void *) {
+                for (size_t i = begin; i < end; i += 1) {
+                    *(uint64_t *)acc += i;
+                }
+            };
+            auto join = [&](void *acc, const void *other, void *) {
+                *(uint64_t *)acc += *(const uint64_t *)other;
+            };
+
+            uint64_t sum{0};
+            REQUIRE(AntTQ_ParallelReduce(tq, 1, 10001, 7,
+                                         Lambda::cify<void, size_t, size_t, void *, void *>(body),
+                                         Lambda::cify<void, void *, const void *, void *>(join),
+                                         &sum, sizeof(sum), NULL) == 0);
+
+            THEN("総和が求まること") {
+                REQUIRE(sum == 50005000);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("待機中の呼び出し元がタスクを実行できること", tags("taskq", "group", "help")) {
+    GIVEN("タスクキューを容量 100, ワーカー 1 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(100, 1)};
+        AntTQ_Start(tq);
+
+        WHEN("ワーカー上のタスクから子タスクのグループを待つ") {
+            std::atomic<int> children{0};
+            std::atomic<int> waited{-2};
+            auto child = [&](TaskId, void *) -> bool {
+                children += 1;
+                return true;
+            };
+            auto parent = [&](TaskId, void *) -> bool {
+                struct TaskGroup *group{AntTQ_GroupCreate(tq)};
+                struct TaskItem item{TASK_ITEM_INITIALIZER};
+                item.Task = Lambda::cify<bool, TaskId, void *>(child);
+                for (int i = 0; i < 10; ++i) {
+                    AntTQ_GroupEnqueue(group, &item);
+                }
+                waited = AntTQ_GroupHelpWait(group, 1000);
+                AntTQ_GroupDestroy(group);
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(parent);
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+
+            THEN("唯一のワーカーが塞がっていても子タスクが完了すること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                REQUIRE(waited == 0);
+                REQUIRE(children == 10);
+            }
+        }
+
+        WHEN("リトライするタスクを待機中に実行する") {
+            AntTQ_Stop(tq);
+            std::atomic<int> task_called{0};
+            auto runner = [&](TaskId, void *) -> bool {
+                task_called += 1;
+                return false;
+            };
+
+            struct TaskGroup *group{AntTQ_GroupCreate(tq)};
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            item.retry = 2;
+            REQUIRE(AntTQ_GroupEnqueue(group, &item) >= 0);
+            AntTQ_Start(tq);
+
+            THEN("リトライを含めて完了すること") {
+                REQUIRE(AntTQ_GroupHelpWait(group, -1) == 0);
+                REQUIRE(task_called == 3);
+            }
+
+            AntTQ_GroupDestroy(group);
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("ワーカー 1 の Worker プールを 2 つのタスクキューで共有する") {
+        struct TaskPool *pool{AntTQ_PoolInit(1, NULL)};
+        REQUIRE(pool != NULL);
+        struct TaskQueue *waiting{AntTQ_InitOnPool(pool, 100, NULL)};
+        struct TaskQueue *other{AntTQ_InitOnPool(pool, 100, NULL)};
+        REQUIRE(waiting != NULL);
+        REQUIRE(other != NULL);
+        AntTQ_Start(waiting);
+        AntTQ_Start(other);
+
+        WHEN("一方のタスクキューのグループを待機中に, 他方へタスクを追加する") {
+            std::atomic<int> called{0};
+            auto runner = [&](TaskId, void *) -> bool {
+                called += 1;
+                return true;
+            };
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+
+            AntTQ_Stop(waiting);
+            struct TaskGroup *group{AntTQ_GroupCreate(waiting)};
+            REQUIRE(AntTQ_GroupEnqueue(group, &item) >= 0);
+            std::atomic<int> waited{-2};
+            std::thread helper([&] {
+                waited = AntTQ_GroupHelpWait(group, -1);
+            });
+            msleep(20);
+
+            THEN("待機者に起床を横取りされずに Worker が実行すること") {
+                for (int i = 1; i <= 20; ++i) {
+                    REQUIRE(AntTQ_Enqueue(other, &item) >= 0);
+                    for (int j = 0; (j < 100) && (called < i); ++j) {
+                        msleep(1);
+                    }
+                    REQUIRE(called == i);
+                    /* Worker が再び休止するのを待つ. */
+                    msleep(5);
+                }
+            }
+
+            AntTQ_Start(waiting);
+            helper.join();
+            REQUIRE(waited == 0);
+            AntTQ_GroupDestroy(group);
+        }
+
+        AntTQ_Term(waiting);
+        AntTQ_Term(other);
+        AntTQ_PoolTerm(pool);
+    }
+}
+
+SCENARIO("複数のタスクキューが Worker プールを共有できること", tags("taskq", "pool")) {
+    GIVEN("ワーカー 1 の Worker プールに重み 3 と重み 1 のタスクキューを作成する") {
+        struct TaskPool *pool{AntTQ_PoolInit(1, NULL)};
+        REQUIRE(pool != NULL);
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.weight = 3;
+        struct TaskQueue *heavy{AntTQ_InitOnPool(pool, 100, &attr)};
+        attr.weight = 1;
+        struct TaskQueue *light{AntTQ_InitOnPool(pool, 100, &attr)};
+        REQUIRE(heavy != NULL);
+        REQUIRE(light != NULL);
+        AntTQ_Start(heavy);
+        AntTQ_Start(light);
+
+        WHEN("Worker を塞いでいる間に両方へ 40 件ずつ追加する") {
+            std::atomic<bool> gate{false};
+            auto blocker = [&](TaskId, void *) -> bool {
+                while (!gate) {
+                    msleep(1);
+                }
+                return true;
+            };
+            std::vector<uintptr_t> order;
+            auto runner = [&](TaskId, void *arg) -> bool {
+                order.push_back((uintptr_t)arg);
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(blocker);
+            REQUIRE(AntTQ_Enqueue(heavy, &item) >= 0);
+            msleep(10);
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            for (int i = 0; i < 40; ++i) {
+                item.arg = (void *)1;
+                REQUIRE(AntTQ_Enqueue(heavy, &item) >= 0);
+                item.arg = (void *)2;
+                REQUIRE(AntTQ_Enqueue(light, &item) >= 0);
+            }
+            gate = true;
+
+            THEN("重みに比例した割合で実行されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                REQUIRE(order.size() == 80);
+                int heavy_count = 0;
+                for (size_t i = 0; i < 40; i += 1) {
+                    heavy_count += (order[i] == 1) ? 1 : 0;
+                }
+                REQUIRE(heavy_count >= 25);
+                REQUIRE(heavy_count <= 35);
+            }
+        }
+
+        AntTQ_Term(heavy);
+        AntTQ_Term(light);
+        AntTQ_PoolTerm(pool);
+    }
+
+    GIVEN("ワーカー 4 の Worker プールに同時実行数 1 のタスクキューを作成する") {
+        struct TaskPool *pool{AntTQ_PoolInit(4, NULL)};
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.max_concurrency = 1;
+        struct TaskQueue *tq{AntTQ_InitOnPool(pool, 100, &attr)};
+        REQUIRE(tq != NULL);
+        AntTQ_Start(tq);
+
+        WHEN("時間のかかるタスクを 10 件追加する") {
+            std::atomic<int> running{0};
+            std::atomic<int> peak{0};
+            std::atomic<int> count{0};
+            auto runner = [&](TaskId, void *) -> bool {
+                int now = ++running;
+                int prev = peak;
+                while ((prev < now) && !peak.compare_exchange_weak(prev, now)) {
+                }
+                msleep(2);
+                --running;
+                count += 1;
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            for (int i = 0; i < 10; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+
+            THEN("同時に 1 件ずつ実行されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                REQUIRE(count == 10);
+                REQUIRE(peak == 1);
+            }
+        }
+
+        AntTQ_Term(tq);
+        AntTQ_PoolTerm(pool);
+    }
+
+    GIVEN("ワーカー 1 の Worker プールにタスクキューを作成する") {
+        struct TaskPool *pool{AntTQ_PoolInit(1, NULL)};
+        REQUIRE(pool != NULL);
+        struct TaskQueue *tq{AntTQ_InitOnPool(pool, 10, NULL)};
+        REQUIRE(tq != NULL);
+        AntTQ_Start(tq);
+
+        WHEN("時間のかかるタスクの実行中に解放する") {
+            std::atomic<bool> started{false};
+            std::atomic<bool> finished{false};
+            auto runner = [&](TaskId, void *) -> bool {
+                started = true;
+                msleep(200);
+                finished = true;
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            for (int i = 0; (i < 1000) && !started; ++i) {
+                msleep(1);
+            }
+
+            struct timespec begin, end;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+            AntTQ_Term(tq);
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+            int64_t cpu_ms = ((end.tv_sec - begin.tv_sec) * 1000)
+                             + ((end.tv_nsec - begin.tv_nsec) / 1000000);
+
+            THEN("タスクの完了まで休止して待つこと") {
+                REQUIRE(started);
+                REQUIRE(finished);
+                REQUIRE(cpu_ms < 50);
+            }
+        }
+
+        AntTQ_PoolTerm(pool);
+    }
+}
+
+SCENARIO("流量制限クラスのタスクが制限されること", tags("taskq", "rate")) {
+    GIVEN("タスクキューを容量 100, ワーカー 2 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(100, 2)};
+        AntTQ_Start(tq);
+
+        WHEN("不正な流量制限クラスを指定する") {
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            auto runner = [&](TaskId, void *) -> bool {
+                return true;
+            };
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            item.rate_class = 1;
+
+            THEN("予約に失敗すること") {
+                REQUIRE(AntTQ_Enqueue(tq, &item) == -1);
+                REQUIRE(errno == EINVAL);
+                REQUIRE(AntTQ_RateClassCreate(tq, "flash", 0, 1, 10) == -1);
+                REQUIRE(AntTQ_RateClassFind(tq, "flash") == -1);
+            }
+        }
+
+        WHEN("毎秒 50 件の流量制限クラスと制限なしのタスクを 10 件ずつ追加する") {
+            int flash{AntTQ_RateClassCreate(tq, "flash", 50, 1, 100)};
+            REQUIRE(flash == 1);
+            REQUIRE(AntTQ_RateClassFind(tq, "flash") == flash);
+
+            std::atomic<int> limited{0};
+            std::atomic<int> unlimited{0};
+            auto runner = [&](TaskId, void *arg) -> bool {
+                ((std::atomic<int> *)arg)->fetch_add(1);
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            item.rate_class = flash;
+            item.arg = &limited;
+            for (int i = 0; i < 10; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            item.rate_class = 0;
+            item.arg = &unlimited;
+            for (int i = 0; i < 10; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+
+            THEN("制限なしのタスクは先に完了し, 制限されたタスクは徐々に実行されること") {
+                msleep(50);
+                REQUIRE(unlimited == 10);
+                REQUIRE(limited < 10);
+
+                /* 非同期処理が終わるのを待つ. */
+                msleep(300);
+                REQUIRE(limited == 10);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("実行期限の早いタスクから処理されること", tags("taskq", "deadline")) {
+    GIVEN("期限順に並べるタスクキューを容量 100, ワーカー 1 で初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.edf_capacity = 100;
+        struct TaskQueue *tq{AntTQ_InitAttr(100, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("停止中に期限の異なるタスクを追加してから開始する") {
+            std::vector<int> order;
+            std::atomic<int> expired{0};
+            auto runner = [&](TaskId, void *arg) -> bool {
+                order.push_back((int)(intptr_t)arg);
+                return true;
+            };
+            auto callback = [&](TaskId, enum TaskStatus status, void *arg) -> bool {
+                if (status == TS_EXPIRED) {
+                    expired = (int)(intptr_t)arg;
+                }
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            item.Callback = Lambda::cify<bool, TaskId, enum TaskStatus, void *>(callback);
+            const unsigned int deadlines[] = {0, 1, 3000, 1000, 2000};
+            for (int i = 0; i < 5; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                item.deadline_ms = deadlines[i];
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            msleep(10);
+            AntTQ_Start(tq);
+
+            THEN("期限切れのタスクは破棄され, 残りは期限順に処理されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                REQUIRE(expired == 1);
+                REQUIRE(order == std::vector<int>{3, 4, 2, 0});
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("期限順に 2 件まで並べるタスクキューを容量 10, 予備 1, ワーカー 1 で初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.edf_capacity = 2;
+        attr.headroom = 1;
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("停止中に期限付きタスクを 3 件追加してから開始する") {
+            std::vector<int> order;
+            auto runner = [&](TaskId, void *arg) -> bool {
+                order.push_back((int)(intptr_t)arg);
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            const unsigned int deadlines[] = {3000, 1000, 2000};
+            for (int i = 0; i < 3; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                item.deadline_ms = deadlines[i];
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            item.deadline_ms = 0;
+            for (int i = 3; i < 9; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            errno = 0;
+            REQUIRE(AntTQ_Enqueue(tq, &item) == -1);
+            REQUIRE(errno == ENOMEM);
+            AntTQ_Start(tq);
+
+            THEN("ヒープに入らない期限付きタスクも予約順に処理されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                REQUIRE(order == std::vector<int>{1, 0, 2, 3, 4, 5, 6, 7, 8});
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("タスク引数の領域がタスク完了後に自動で解放されること", tags("taskq", "arg")) {
+    GIVEN("タスク引数スラブを持つタスクキューを容量 10, ワーカー 1 で初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.arg_slots = 2;
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("スラブの上限まで確保する") {
+            void *a{AntTQ_AllocArg(tq, 40)};
+            void *b{AntTQ_AllocArg(tq, 64)};
+
+            THEN("それ以上は確保できないこと") {
+                REQUIRE(a != nullptr);
+                REQUIRE(b != nullptr);
+                REQUIRE(AntTQ_AllocArg(tq, 50) == nullptr);
+                REQUIRE(errno == ENOMEM);
+                REQUIRE(AntTQ_AllocArg(tq, 4096) == nullptr);
+                REQUIRE(errno == EINVAL);
+
+                AntTQ_FreeArg(tq, b);
+                REQUIRE(AntTQ_AllocArg(tq, 50) == b);
+            }
+        }
+
+        WHEN("確保した領域を引数にしたタスクを完了, 取り消しする") {
+            std::atomic<int> sum{0};
+            auto runner = [&](TaskId, void *arg) -> bool {
+                sum += *(int *)arg;
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            item.arg = AntTQ_AllocArg(tq, sizeof(int));
+            *(int *)item.arg = 7;
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            item.arg = AntTQ_AllocArg(tq, sizeof(int));
+            *(int *)item.arg = 11;
+            REQUIRE(AntTQ_Cancel(tq, AntTQ_Enqueue(tq, &item)) == 0);
+            REQUIRE(AntTQ_AllocArg(tq, sizeof(int)) == nullptr);
+            AntTQ_Start(tq);
+
+            THEN("どちらの領域も再び確保できること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                REQUIRE(sum == 7);
+                REQUIRE(AntTQ_AllocArg(tq, sizeof(int)) != nullptr);
+                REQUIRE(AntTQ_AllocArg(tq, sizeof(int)) != nullptr);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("タスクの結果を完了リングから取得できること", tags("taskq", "completion")) {
+    GIVEN("完了リングを持つタスクキューを容量 10, ワーカー 1 で初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.completion_capacity = 16;
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        auto runner = [&](TaskId, void *arg) -> bool {
+            AntTQ_SetResult((intptr_t)arg * 10);
+            return (intptr_t)arg != 2;
+        };
+        struct TaskItem item{TASK_ITEM_INITIALIZER};
+        item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+
+        WHEN("タスクの外から結果を設定する") {
+            THEN("失敗すること") {
+                REQUIRE(AntTQ_SetResult(1) == -1);
+                REQUIRE(errno == EPERM);
+            }
+        }
+
+        WHEN("結果を設定するタスクを 3 件追加する") {
+            std::vector<TaskId> ids;
+            for (intptr_t i = 1; i <= 3; ++i) {
+                item.arg = (void *)i;
+                ids.push_back(AntTQ_Enqueue(tq, &item));
+            }
+            AntTQ_Start(tq);
+
+            THEN("最終状態と結果のみが記録されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                struct TaskCompletion completions[8];
+                REQUIRE(AntTQ_Harvest(tq, completions, 8) == 3);
+                for (int i = 0; i < 3; ++i) {
+                    REQUIRE(completions[i].id == ids[i]);
+                    REQUIRE(completions[i].status == ((i == 1) ? TS_FAIL : TS_SUCCESS));
+                    REQUIRE(completions[i].result == (i + 1) * 10);
+                }
+                REQUIRE(AntTQ_Harvest(tq, completions, 8) == 0);
+                REQUIRE(AntTQ_CompletionOverflow(tq) == 0);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("完了リングを持つタスクキューを容量 10, ワーカー 1 で初期化し, 通知を監視する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.completion_capacity = 16;
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+        struct pollfd pfd{AntTQ_GetCompletionFd(tq), POLLIN, 0};
+        REQUIRE(pfd.fd >= 0);
+        REQUIRE(poll(&pfd, 1, 0) == 0);
+
+        WHEN("タスクを 3 件追加する") {
+            auto runner = [&](TaskId, void *) -> bool {
+                return true;
+            };
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            for (int i = 0; i < 3; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            AntTQ_Start(tq);
+
+            THEN("取得し終えるまで通知が続くこと") {
+                REQUIRE(poll(&pfd, 1, 1000) == 1);
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                struct TaskCompletion completions[2];
+                REQUIRE(AntTQ_Harvest(tq, completions, 2) == 2);
+                REQUIRE(poll(&pfd, 1, 0) == 1);
+                REQUIRE(AntTQ_Harvest(tq, completions, 2) == 1);
+                REQUIRE(poll(&pfd, 1, 0) == 0);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("開始通知も記録する容量 2 の完了リングでタスクキューを初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.completion_capacity = 2;
+        attr.completion_events = TS_MASK(TS_ACK) | TS_MASK(TS_SUCCESS);
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("タスクを 2 件追加する") {
+            auto runner = [&](TaskId, void *) -> bool {
+                return true;
+            };
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            AntTQ_Start(tq);
+
+            THEN("記録できなかった数が数えられること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                struct TaskCompletion completions[4];
+                REQUIRE(AntTQ_Harvest(tq, completions, 4) == 2);
+                REQUIRE(completions[0].status == TS_ACK);
+                REQUIRE(completions[1].status == TS_SUCCESS);
+                REQUIRE(AntTQ_CompletionOverflow(tq) == 2);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("ブロッキングタスクが Worker を塞がないこと", tags("taskq", "blocking")) {
+    GIVEN("ブロッキングタスク用スレッドを 4 つまで使うタスクキューを容量 10, ワーカー 1 で初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.blocking_workers = 4;
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        WHEN("ブロッキングタスクを 3 件追加してから, 通常のタスクを追加する") {
+            std::atomic<int> blocked{0};
+            std::atomic<int> computed{0};
+            std::atomic<int> succeeded{0};
+            auto sleeper = [&](TaskId, void *) -> bool {
+                msleep(100);
+                blocked += 1;
+                return true;
+            };
+            auto runner = [&](TaskId, void *) -> bool {
+                computed += 1;
+                return true;
+            };
+            auto callback = [&](TaskId, enum TaskStatus status, void *) -> bool {
+                if (status == TS_SUCCESS) {
+                    succeeded += 1;
+                }
+                return true;
+            };
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(sleeper);
+            item.Callback = Lambda::cify<bool, TaskId, enum TaskStatus, void *>(callback);
+            item.blocking = true;
+            for (int i = 0; i < 3; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            item.blocking = false;
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+
+            THEN("通常のタスクが先に完了し, ブロッキングタスクは並行して完了すること") {
+                msleep(50);
+                REQUIRE(computed == 1);
+                REQUIRE(blocked == 0);
+
+                /* 非同期処理が終わるのを待つ. */
+                msleep(150);
+                REQUIRE(blocked == 3);
+                REQUIRE(succeeded == 4);
+            }
+        }
+
+        WHEN("ブロッキングタスク用スレッドのないタスクキューに追加する") {
+            struct TaskQueue *plain{AntTQ_Init(10, 1)};
+            auto runner = [&](TaskId, void *) -> bool {
+                return true;
+            };
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            item.blocking = true;
+
+            THEN("予約に失敗すること") {
+                REQUIRE(AntTQ_Enqueue(plain, &item) == -1);
+                REQUIRE(errno == EINVAL);
+            }
+
+            AntTQ_Term(plain);
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("ブロッキングタスク用スレッドを 1 つだけ使うタスクキューを容量 10, ワーカー 1 で初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.blocking_workers = 1;
+        attr.arg_slots = 4;
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        WHEN("ブロッキングタスクの実行中に, グループのブロッキングタスクを 3 件追加して終了する") {
+            std::atomic<int> canceled{0};
+            auto sleeper = [&](TaskId, void *) -> bool {
+                msleep(50);
+                return true;
+            };
+            auto callback = [&](TaskId, enum TaskStatus status, void *) -> bool {
+                if (status == TS_CANCELED) {
+                    canceled += 1;
+                }
+                return true;
+            };
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(sleeper);
+            item.Callback = Lambda::cify<bool, TaskId, enum TaskStatus, void *>(callback);
+            item.blocking = true;
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            msleep(10);
+            struct TaskGroup *group{AntTQ_GroupCreate(tq)};
+            for (int i = 0; i < 3; ++i) {
+                item.arg = AntTQ_AllocArg(tq, 16);
+                REQUIRE(item.arg != nullptr);
+                REQUIRE(AntTQ_GroupEnqueue(group, &item) >= 0);
+            }
+            AntTQ_Term(tq);
+
+            THEN("未実行のタスクに TS_CANCELED が通知され, グループの待機が終わること") {
+                REQUIRE(canceled == 3);
+                REQUIRE(AntTQ_GroupWait(group, 0) == 0);
+            }
+
+            AntTQ_GroupDestroy(group);
+        }
+    }
+}
+
+SCENARIO("Worker ごとの資源と作業領域を使えること", tags("taskq", "worker")) {
+    GIVEN("Worker の開始, 終了時の関数と作業領域を指定する") {
+        std::atomic<int> inits{0};
+        std::atomic<int> finis{0};
+        auto init = [&](void *) -> void * {
+            return new int{inits.fetch_add(1)};
+        };
+        auto fini = [&](void *local, void *) -> void {
+            delete (int *)local;
+            finis += 1;
+        };
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.WorkerInit = Lambda::cify<void *, void *>(init);
+        attr.WorkerFini = Lambda::cify<void, void *, void *>(fini);
+        attr.scratch_bytes = 256;
+
+        WHEN("ワーカー 2 で初期化し, 作業領域を使うタスクを 10 件処理する") {
+            struct TaskQueue *tq{AntTQ_InitAttr(10, 2, &attr)};
+            REQUIRE(tq != nullptr);
+            AntTQ_Start(tq);
+
+            std::atomic<int> succeeded{0};
+            auto runner = [&](TaskId, void *) -> bool {
+                int *local = (int *)AntTQ_WorkerLocal();
+                char *a = (char *)AntTQ_WorkerScratch(100);
+                char *b = (char *)AntTQ_WorkerScratch(100);
+                void *c = AntTQ_WorkerScratch(100);
+                if ((local != nullptr) && (*local < 2) && (a != nullptr) && (b >= (a + 100))
+                    && (((uintptr_t)b % 16) == 0) && (c == nullptr) && (errno == ENOMEM)) {
+                    succeeded += 1;
+                }
+                return true;
+            };
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            for (int i = 0; i < 10; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+
+            THEN("作業領域がタスクごとに解放され, Worker ごとに開始, 終了時の関数が呼ばれること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(succeeded == 10);
+                REQUIRE(AntTQ_WorkerScratch(1) == nullptr);
+                REQUIRE(errno == EPERM);
+
+                AntTQ_Term(tq);
+                REQUIRE(inits == 2);
+                REQUIRE(finis == 2);
+            }
+        }
+    }
+}
+
+SCENARIO("すべての Worker でタスクを 1 回ずつ実行できること", tags("taskq", "broadcast")) {
+    GIVEN("タスクキューを容量 100, ワーカー 3 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(100, 3)};
+        AntTQ_Start(tq);
+
+        std::mutex mutex;
+        std::set<pthread_t> threads;
+        std::atomic<int> called{0};
+        auto runner = [&](TaskId, void *) -> bool {
+            std::lock_guard<std::mutex> guard{mutex};
+            threads.insert(pthread_self());
+            called += 1;
+            return true;
+        };
+
+        WHEN("通常のタスクを処理中にグループで全 Worker 宛てタスクを実行する") {
+            std::atomic<int> busy{0};
+            auto sleeper = [&](TaskId, void *) -> bool {
+                msleep(1);
+                busy += 1;
+                return true;
+            };
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(sleeper);
+            for (int i = 0; i < 30; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+
+            struct TaskGroup *group{AntTQ_GroupCreate(tq)};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            REQUIRE(AntTQ_GroupBroadcast(group, &item) >= 0);
+
+            THEN("各 Worker で 1 回ずつ実行されること") {
+                REQUIRE(AntTQ_GroupWait(group, 1000) == 0);
+                REQUIRE(called == 3);
+                REQUIRE(threads.size() == 3);
+            }
+
+            AntTQ_GroupDestroy(group);
+        }
+
+        WHEN("休止中の Worker に全 Worker 宛てタスクを配送する") {
+            msleep(50);
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            REQUIRE(AntTQ_Broadcast(tq, &item) >= 0);
+            item.retry = 1;
+            REQUIRE(AntTQ_Broadcast(tq, &item) == -1);
+            REQUIRE(errno == EINVAL);
+            item.retry = 0;
+            item.coalesce_key = 1;
+            REQUIRE(AntTQ_Broadcast(tq, &item) == -1);
+            REQUIRE(errno == EINVAL);
+            item.coalesce_key = 0;
+            item.fiber = true;
+            REQUIRE(AntTQ_Broadcast(tq, &item) == -1);
+            REQUIRE(errno == EINVAL);
+
+            THEN("各 Worker で 1 回ずつ実行されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+
+                REQUIRE(called == 3);
+                REQUIRE(threads.size() == 3);
+            }
+        }
+
+        WHEN("停止中の Task Queue で全 Worker 宛てタスクを実行する") {
+            AntTQ_Stop(tq);
+            struct TaskGroup *group{AntTQ_GroupCreate(tq)};
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            REQUIRE(AntTQ_GroupBroadcast(group, &item) >= 0);
+
+            THEN("停止中も各 Worker で 1 回ずつ実行されること") {
+                REQUIRE(AntTQ_GroupWait(group, 1000) == 0);
+                REQUIRE(called == 3);
+                REQUIRE(threads.size() == 3);
+            }
+
+            AntTQ_GroupDestroy(group);
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+template <int N>
+static bool Numbered(TaskId, void *arg) {
+    *(std::atomic<int> *)arg += N;
+    return true;
+}
+
+template <int... N>
+static std::vector<int> RegisterNumbered(struct TaskQueue *tq, std::integer_sequence<int, N...>) {
+    return std::vector<int>{AntTQ_Register(tq, Numbered<N + 1>, nullptr)...};
+}
+
+SCENARIO("登録したタスク関数を番号で予約できること", tags("taskq", "register")) {
+    GIVEN("タスクキューを容量 100, ワーカー 2 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(100, 2)};
+        AntTQ_Start(tq);
+
+        std::atomic<int> total{0};
+
+        WHEN("タスク関数を登録して番号で予約する") {
+            int fn = AntTQ_Register(tq, Numbered<1>, nullptr);
+            REQUIRE(fn >= 1);
+            REQUIRE(AntTQ_Register(tq, Numbered<1>, nullptr) == fn);
+            for (int i = 0; i < 10; ++i) {
+                REQUIRE(AntTQ_EnqueueFn(tq, fn, &total) >= 0);
+            }
+            REQUIRE(AntTQ_EnqueueFn(tq, 0, &total) == -1);
+            REQUIRE(errno == EINVAL);
+            REQUIRE(AntTQ_EnqueueFn(tq, fn + 1, &total) == -1);
+            REQUIRE(errno == EINVAL);
+
+            THEN("登録した関数で処理されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(total == 10);
+            }
+        }
+
+        WHEN("関数表を使い切ってから未登録の関数を予約する") {
+            std::vector<int> fns = RegisterNumbered(tq, std::make_integer_sequence<int, 63>{});
+            REQUIRE(std::set<int>(fns.begin(), fns.end()).size() == 63);
+            REQUIRE(AntTQ_Register(tq, Numbered<100>, nullptr) == -1);
+            REQUIRE(errno == ENOSPC);
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Numbered<100>;
+            item.arg = &total;
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            REQUIRE(AntTQ_EnqueueFn(tq, fns[62], &total) >= 0);
+
+            THEN("付加情報に保持した関数で処理されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(total == 163);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("キューが満杯の時に受け入れ方針に従うこと", tags("taskq", "admission")) {
+    std::vector<int> order;
+    std::vector<int> dropped;
+    auto runner = [&](TaskId, void *arg) -> bool {
+        order.push_back((int)(intptr_t)arg);
+        return true;
+    };
+    auto callback = [&](TaskId, enum TaskStatus status, void *arg) -> bool {
+        if (status == TS_DROPPED) {
+            dropped.push_back((int)(intptr_t)arg);
+        }
+        return true;
+    };
+    struct TaskItem item{TASK_ITEM_INITIALIZER};
+    item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+    item.Callback = Lambda::cify<bool, TaskId, enum TaskStatus, void *>(callback);
+    struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+
+    GIVEN("予備の容量 1 を持つタスクキューを容量 4, ワーカー 1 で初期化する") {
+        attr.headroom = 1;
+        struct TaskQueue *tq{AntTQ_InitAttr(4, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("停止中に通常のタスクと優先タスクを予約する") {
+            for (int i = 0; i < 3; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            REQUIRE(AntTQ_Enqueue(tq, &item) == -1);
+            REQUIRE(errno == ENOMEM);
+            item.priority = true;
+            item.arg = (void *)(intptr_t)3;
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            REQUIRE(AntTQ_Enqueue(tq, &item) == -1);
+            REQUIRE(errno == ENOMEM);
+
+            THEN("優先タスクのみ予備の容量を使用できること") {
+                AntTQ_Start(tq);
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(order == std::vector<int>{0, 1, 2, 3});
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("古いタスクを破棄するタスクキューを容量 3, ワーカー 1 で初期化する") {
+        attr.admission = AP_DROP_OLDEST;
+        struct TaskQueue *tq{AntTQ_InitAttr(3, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("停止中に容量を超えてタスクを予約する") {
+            for (int i = 0; i < 5; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+
+            THEN("古いタスクが TS_DROPPED で破棄され, 新しいタスクが処理されること") {
+                REQUIRE(dropped == std::vector<int>{0, 1});
+                AntTQ_Start(tq);
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(order == std::vector<int>{2, 3, 4});
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("呼び出し元で実行するタスクキューを容量 2, ワーカー 1 で初期化する") {
+        attr.admission = AP_CALLER_RUNS;
+        struct TaskQueue *tq{AntTQ_InitAttr(2, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("停止中に容量を超えてタスクを予約する") {
+            for (int i = 0; i < 3; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+
+            THEN("溢れたタスクが呼び出し元で直ちに実行されること") {
+                REQUIRE(order == std::vector<int>{2});
+                AntTQ_Start(tq);
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(order == std::vector<int>{2, 0, 1});
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("呼び出し元で実行するタスクキューを容量 4, ワーカー 1 で初期化する") {
+        attr.admission = AP_CALLER_RUNS;
+        struct TaskQueue *tq{AntTQ_InitAttr(4, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("停止中に流量制限クラスを容量を超えて埋めてから, 制限なしのタスクを予約する") {
+            REQUIRE(AntTQ_RateClassCreate(tq, "slow", 1, 1, 5) == -1);
+            REQUIRE(errno == EINVAL);
+            int slow{AntTQ_RateClassCreate(tq, "slow", 1, 1, 2)};
+            REQUIRE(slow == 1);
+            item.rate_class = slow;
+            for (int i = 0; i < 3; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            std::vector<int> inline_order = order;
+            item.rate_class = 0;
+            for (int i = 10; i < 14; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+
+            THEN("クラスから溢れたタスクのみが呼び出し元で実行され, 制限なしのタスクは受け付けられること") {
+                REQUIRE(inline_order == std::vector<int>{2});
+                REQUIRE(order == std::vector<int>{2});
+                AntTQ_Start(tq);
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(std::multiset<int>(order.begin(), order.end())
+                        == std::multiset<int>{0, 2, 10, 11, 12, 13});
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("不正な受け入れ方針を指定する") {
+        attr.headroom = 4;
+
+        THEN("初期化に失敗すること") {
+            REQUIRE(AntTQ_InitAttr(4, 1, &attr) == nullptr);
+            REQUIRE(errno == EINVAL);
+        }
+    }
+}
+
+SCENARIO("実行時間の上限を超えたタスクを検出できること", tags("taskq", "watchdog")) {
+    GIVEN("Watchdog を有効にしたタスクキューを容量 100, ワーカー 1 で初期化する") {
+        std::atomic<int> reported{0};
+        std::atomic<TaskId> stuck_id{-1};
+        auto hook = [&](TaskId id, unsigned int elapsed_ms, void *) {
+            if (elapsed_ms >= 50) {
+                stuck_id = id;
+            }
+            reported += 1;
+        };
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.watchdog_ms = 50;
+        attr.TaskStuck = Lambda::cify<void, TaskId, unsigned int, void *>(hook);
+        attr.spare_workers = 1;
+        struct TaskQueue *tq{AntTQ_InitAttr(100, 1, &attr)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        WHEN("Worker を塞ぐタスクの後に通常のタスクを予約する") {
+            std::atomic<bool> release{false};
+            auto blocker = [&](TaskId, void *) -> bool {
+                for (int i = 0; (i < 1000) && !release; ++i) {
+                    msleep(1);
+                }
+                return true;
+            };
+            std::atomic<int> count{0};
+            auto runner = [&](TaskId, void *) -> bool {
+                count += 1;
+                return true;
+            };
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(blocker);
+            TaskId id = AntTQ_Enqueue(tq, &item);
+            REQUIRE(id >= 0);
+            msleep(10);
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            for (int i = 0; i < 10; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+
+            THEN("塞いでいるタスクが 1 度だけ報告され, 代替 Worker が残りを処理すること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(300);
+                REQUIRE(reported == 1);
+                REQUIRE(stuck_id == id);
+                REQUIRE(count == 10);
+            }
+
+            release = true;
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("実行中のタスクから子タスクを生成して待ち合わせられること", tags("taskq", "spawn")) {
+    GIVEN("ローカルバッファを持つタスクキューを容量 100, ワーカー 3 で初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.spawn_capacity = 64;
+        struct TaskQueue *tq{AntTQ_InitAttr(100, 3, &attr)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        std::atomic<int> leaves{0};
+        std::atomic<int> joined{-1};
+        bool (*walker)(TaskId, void *) = nullptr;
+        auto walk = [&](TaskId, void *arg) -> bool {
+            int depth = (int)(intptr_t)arg;
+            if (depth == 10) {
+                leaves += 1;
+                return true;
+            }
+            struct TaskItem child{TASK_ITEM_INITIALIZER};
+            child.Task = walker;
+            child.arg = (void *)(intptr_t)(depth + 1);
+            AntTQ_Spawn(&child);
+            AntTQ_Spawn(&child);
+            if (depth == 0) {
+                AntTQ_Join();
+                joined = leaves.load();
+            }
+            return true;
+        };
+        walker = Lambda::cify<bool, TaskId, void *>(walk);
+
+        WHEN("2 分木を再帰的に子タスクで辿る") {
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = walker;
+            item.arg = (void *)(intptr_t)0;
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+
+            THEN("待ち合わせ後にすべての葉が処理済みであること") {
+                /* 非同期処理が終わるのを待つ. */
+                for (int i = 0; (i < 100) && (joined < 0); ++i) {
+                    msleep(10);
+                }
+                REQUIRE(joined == 1024);
+                REQUIRE(leaves == 1024);
+            }
+        }
+
+        WHEN("タスクの実行中以外で子タスクを生成する") {
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = walker;
+
+            THEN("失敗すること") {
+                REQUIRE(AntTQ_Spawn(&item) == -1);
+                REQUIRE(errno == EPERM);
+                REQUIRE(AntTQ_Join() == -1);
+                REQUIRE(errno == EPERM);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("fd の準備完了でタスクが予約されること", tags("taskq", "reactor")) {
+    GIVEN("fd を監視できるタスクキューを容量 10, ワーカー 2 で初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.fd_watches = 4;
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 2, &attr)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+
+        std::atomic<int> runs{0};
+        auto reader = [&](TaskId, void *) -> bool {
+            char c;
+            REQUIRE(read(fds[0], &c, 1) == 1);
+            runs += 1;
+            return true;
+        };
+        struct TaskItem item{TASK_ITEM_INITIALIZER};
+        item.Task = Lambda::cify<bool, TaskId, void *>(reader);
+
+        WHEN("読み込み可能になるのを待つタスクを登録する") {
+            REQUIRE(AntTQ_EnqueueOnFd(tq, fds[0], EPOLLIN, &item) >= 0);
+            REQUIRE(AntTQ_EnqueueOnFd(tq, fds[0], EPOLLIN, &item) == -1);
+            REQUIRE(errno == EBUSY);
+            msleep(20);
+            REQUIRE(runs == 0);
+            REQUIRE(write(fds[1], "abc", 3) == 3);
+
+            THEN("準備完了がまとめられ, 再登録するまで 1 度だけ予約されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(50);
+                REQUIRE(runs == 1);
+
+                REQUIRE(AntTQ_EnqueueOnFd(tq, fds[0], EPOLLIN, &item) >= 0);
+                msleep(50);
+                REQUIRE(runs == 2);
+
+                REQUIRE(AntTQ_UnwatchFd(tq, fds[0]) == 0);
+                REQUIRE(AntTQ_UnwatchFd(tq, fds[0]) == -1);
+                REQUIRE(errno == ENOENT);
+            }
+        }
+
+        WHEN("fd を監視しないタスクキューに登録する") {
+            struct TaskQueue *plain{AntTQ_Init(10, 1)};
+
+            THEN("失敗すること") {
+                REQUIRE(AntTQ_EnqueueOnFd(plain, fds[0], EPOLLIN, &item) == -1);
+                REQUIRE(errno == EINVAL);
+            }
+
+            AntTQ_Term(plain);
+        }
+
+        AntTQ_Term(tq);
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    GIVEN("fd を 40 個監視できるタスクキューを容量 4, ワーカー 1 で初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.fd_watches = 40;
+        struct TaskQueue *tq{AntTQ_InitAttr(4, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        auto runner = [](TaskId, void *) -> bool {
+            return true;
+        };
+        struct TaskItem item{TASK_ITEM_INITIALIZER};
+        item.Task = runner;
+        item.retry = 1;
+
+        WHEN("付加情報を持つタスクで 40 個の fd の準備完了を待つ") {
+            std::vector<int> efds;
+            for (int i = 0; i < 40; ++i) {
+                efds.push_back(eventfd(0, EFD_NONBLOCK));
+                REQUIRE(AntTQ_EnqueueOnFd(tq, efds.back(), EPOLLIN, &item) >= 0);
+            }
+
+            THEN("付加情報を持つタスクをキューの容量まで予約できること") {
+                for (int i = 0; i < 4; ++i) {
+                    REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+                }
+            }
+
+            for (int efd : efds) {
+                AntTQ_UnwatchFd(tq, efd);
+                close(efd);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("呼び出し元で実行する受け入れ方針で, fd を監視できるタスクキューを容量 2, ワーカー 1 で初期化する") {
+        struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+        attr.fd_watches = 1;
+        attr.admission = AP_CALLER_RUNS;
+        struct TaskQueue *tq{AntTQ_InitAttr(2, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("キューが満杯の間に fd が準備完了になる") {
+            std::atomic<int> runs{0};
+            std::atomic<int> dropped{0};
+            auto runner = [&](TaskId, void *) -> bool {
+                runs += 1;
+                return true;
+            };
+            auto callback = [&](TaskId, enum TaskStatus status, void *) -> bool {
+                if (status == TS_DROPPED) {
+                    dropped += 1;
+                }
+                return true;
+            };
+            struct TaskItem filler{TASK_ITEM_INITIALIZER};
+            filler.Task = [](TaskId, void *) -> bool { return true; };
+            for (int i = 0; i < 2; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &filler) >= 0);
+            }
+
+            struct TaskItem item{TASK_ITEM_INITIALIZER};
+            item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+            item.Callback = Lambda::cify<bool, TaskId, enum TaskStatus, void *>(callback);
+            int efd = eventfd(1, EFD_NONBLOCK);
+            REQUIRE(AntTQ_EnqueueOnFd(tq, efd, EPOLLIN, &item) >= 0);
+
+            THEN("Reactor のスレッドでは実行せず, 破棄を通知すること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(50);
+                REQUIRE(dropped == 1);
+                REQUIRE(runs == 0);
+            }
+
+            AntTQ_UnwatchFd(tq, efd);
+            close(efd);
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("同じ合流キーの未実行のタスクに合流できること", tags("taskq", "coalesce")) {
+    std::vector<int> order;
+    auto runner = [&](TaskId, void *arg) -> bool {
+        order.push_back((int)(intptr_t)arg);
+        return true;
+    };
+    auto merge = [](void *pending, void *arg) -> void * {
+        return (void *)((intptr_t)pending + (intptr_t)arg);
+    };
+    struct TaskItem item{TASK_ITEM_INITIALIZER};
+    item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+    struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+
+    GIVEN("合流キーの表を持つタスクキューを容量 10, ワーカー 1 で初期化する") {
+        attr.coalesce_slots = 16;
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("停止中に同じ合流キーのタスクを最初の引数を残して予約する") {
+            item.coalesce_key = 7;
+            item.coalesce = CP_KEEP_FIRST;
+            TaskId first = -1;
+            for (int i = 1; i <= 3; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                TaskId id = AntTQ_Enqueue(tq, &item);
+                REQUIRE(id >= 0);
+                if (first < 0) {
+                    first = id;
+                }
+                REQUIRE(id == first);
+            }
+            item.coalesce_key = 8;
+            item.arg = (void *)(intptr_t)10;
+            REQUIRE(AntTQ_Enqueue(tq, &item) != first);
+
+            THEN("合流キーごとに 1 度だけ最初の引数で実行されること") {
+                AntTQ_Start(tq);
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(order == std::vector<int>{1, 10});
+            }
+        }
+
+        WHEN("停止中に同じ合流キーのタスクを最後の引数で置き換えて予約する") {
+            item.coalesce_key = 7;
+            item.coalesce = CP_KEEP_LAST;
+            for (int i = 1; i <= 3; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+
+            THEN("最後の引数で 1 度だけ実行されること") {
+                AntTQ_Start(tq);
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(order == std::vector<int>{3});
+            }
+        }
+
+        WHEN("停止中に同じ合流キーのタスクを統合して予約する") {
+            item.coalesce_key = 7;
+            item.coalesce = CP_MERGE;
+            item.Merge = merge;
+            for (int i = 1; i <= 4; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+
+            THEN("統合した引数で 1 度だけ実行されること") {
+                AntTQ_Start(tq);
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(order == std::vector<int>{10});
+            }
+        }
+
+        WHEN("実行済みのタスクと同じ合流キーのタスクを予約する") {
+            item.coalesce_key = 7;
+            item.arg = (void *)(intptr_t)1;
+            TaskId first = AntTQ_Enqueue(tq, &item);
+            REQUIRE(first >= 0);
+            AntTQ_Start(tq);
+            msleep(50);
+            item.arg = (void *)(intptr_t)2;
+
+            THEN("合流せずに新たに実行されること") {
+                REQUIRE(AntTQ_Enqueue(tq, &item) != first);
+                /* 非同期処理が終わるのを待つ. */
+                msleep(50);
+                REQUIRE(order == std::vector<int>{1, 2});
+            }
+        }
+
+        WHEN("統合関数なしで統合を指定する") {
+            item.coalesce_key = 7;
+            item.coalesce = CP_MERGE;
+
+            THEN("予約に失敗すること") {
+                REQUIRE(AntTQ_Enqueue(tq, &item) == -1);
+                REQUIRE(errno == EINVAL);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("2 のべき乗でない合流キーの表の要素数を指定する") {
+        attr.coalesce_slots = 10;
+
+        THEN("初期化に失敗すること") {
+            REQUIRE(AntTQ_InitAttr(10, 1, &attr) == nullptr);
+            REQUIRE(errno == EINVAL);
+        }
+    }
+}
+
+SCENARIO("実行を終えたタスクの識別子が新しいタスクを指さないこと", tags("taskq", "handle")) {
+    std::atomic<int> task_called{0};
+    auto runner = [&](TaskId, void *) -> bool {
+        task_called += 1;
+        return true;
+    };
+    struct TaskItem item{TASK_ITEM_INITIALIZER};
+    item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+
+    GIVEN("タスクキューを容量 1, ワーカー 1 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(1, 1)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        WHEN("タスクの実行後に, 同じ領域を使う新しいタスクを予約する") {
+            TaskId stale = AntTQ_Enqueue(tq, &item);
+            REQUIRE(stale >= 0);
+            /* 非同期処理が終わるのを待つ. */
+            msleep(50);
+            AntTQ_Stop(tq);
+            TaskId fresh = AntTQ_Enqueue(tq, &item);
+            REQUIRE(fresh > stale);
+
+            THEN("古い識別子では新しいタスクを削除できないこと") {
+                REQUIRE(AntTQ_Cancel(tq, stale) == -1);
+                REQUIRE(errno == ENOENT);
+                REQUIRE(AntTQ_Cancel(tq, fresh + 1) == -1);
+                REQUIRE(AntTQ_Cancel(tq, -1) == -1);
+                REQUIRE(errno == EINVAL);
+                AntTQ_Start(tq);
+                /* 非同期処理が終わるのを待つ. */
+                msleep(50);
+                REQUIRE(task_called == 2);
+            }
+        }
+
+        WHEN("停止中に予約したタスクの後に, 予約の失敗を 1000 回繰り返してから範囲で削除する") {
+            AntTQ_Stop(tq);
+            TaskId pending = AntTQ_Enqueue(tq, &item);
+            REQUIRE(pending >= 0);
+            TaskId last = -1;
+            for (int i = 0; i < 1000; ++i) {
+                last = AntTQ_Enqueue(tq, &item);
+            }
+            REQUIRE(last == -1);
+            REQUIRE(errno == ENOMEM);
+            REQUIRE(AntTQ_CancelRange(tq, pending, pending) == 0);
+            AntTQ_Start(tq);
+
+            THEN("多くの世代が後に発行されても削除されること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(50);
+                REQUIRE(task_called == 0);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("停止中のタスクキューを容量 100000, ワーカー 2 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(100000, 2)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("16 ビットを超える数のタスクを予約し, 一部を範囲で削除する") {
+            std::vector<TaskId> ids;
+            for (int i = 0; i < 40000; ++i) {
+                ids.push_back(AntTQ_Enqueue(tq, &item));
+            }
+            REQUIRE(std::all_of(ids.begin(), ids.end(), [](TaskId id) { return id >= 0; }));
+            REQUIRE(std::is_sorted(ids.begin(), ids.end()));
+            REQUIRE(AntTQ_CancelRange(tq, ids[35000], ids[39999]) == 0);
+            REQUIRE(AntTQ_Cancel(tq, ids[0]) == 0);
+            AntTQ_Start(tq);
+
+            THEN("削除していないタスクがすべて処理されること") {
+                for (int i = 0; (i < 200) && (task_called < 34999); ++i) {
+                    msleep(10);
+                }
+                msleep(20);
+                REQUIRE(task_called == 34999);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("ワーカーなしで呼び出し元のスレッドからタスクを実行できること", tags("taskq", "pump")) {
+    GIVEN("タスクキューを容量 10, ワーカー 0 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(10, 0)};
+        REQUIRE(tq != nullptr);
+
+        std::vector<int> order;
+        std::set<pthread_t> threads;
+        auto runner = [&](TaskId, void *arg) -> bool {
+            threads.insert(pthread_self());
+            order.push_back((int)(intptr_t)arg);
+            return (intptr_t)arg != 0;
+        };
+        std::vector<enum TaskStatus> statuses;
+        auto callback = [&](TaskId, enum TaskStatus status, void *) -> bool {
+            statuses.push_back(status);
+            return true;
+        };
+        struct TaskItem item{TASK_ITEM_INITIALIZER};
+        item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+
+        WHEN("タスクを 5 件予約し, 上限を指定して実行する") {
+            for (int i = 1; i <= 5; ++i) {
+                item.arg = (void *)(intptr_t)i;
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            REQUIRE(AntTQ_RunPending(tq, 0, 0) == 0);
+            AntTQ_Start(tq);
+            msleep(20);
+            REQUIRE(order.empty());
+
+            THEN("呼び出し元のスレッドで上限の数ずつ順に実行されること") {
+                REQUIRE(AntTQ_RunPending(tq, 3, 0) == 3);
+                REQUIRE(order == std::vector<int>{1, 2, 3});
+                REQUIRE(AntTQ_RunPending(tq, 0, 0) == 2);
+                REQUIRE(order == std::vector<int>{1, 2, 3, 4, 5});
+                REQUIRE(threads == std::set<pthread_t>{pthread_self()});
+                REQUIRE(AntTQ_RunPending(tq, 0, 0) == 0);
+            }
+        }
+
+        WHEN("失敗するタスクをリトライ 1 回で予約して実行する") {
+            item.Callback = Lambda::cify<bool, TaskId, enum TaskStatus, void *>(callback);
+            item.arg = (void *)(intptr_t)0;
+            item.retry = 1;
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            AntTQ_Start(tq);
+
+            THEN("Worker と同じくリトライと通知が行われること") {
+                REQUIRE(AntTQ_RunPending(tq, 0, 0) == 2);
+                REQUIRE(statuses == std::vector<enum TaskStatus>{TS_ACK, TS_RETRY, TS_ACK, TS_FAIL});
+            }
+        }
+
+        WHEN("時間のかかるタスクを予約し, 実行時間の上限を指定して実行する") {
+            auto slow = [&](TaskId, void *) -> bool {
+                msleep(10);
+                return true;
+            };
+            item.Task = Lambda::cify<bool, TaskId, void *>(slow);
+            for (int i = 0; i < 5; ++i) {
+                REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            }
+            AntTQ_Start(tq);
+
+            THEN("上限を超えた時点で戻ること") {
+                ssize_t ran = AntTQ_RunPending(tq, 0, 15 * 1000000);
+                REQUIRE((1 <= ran && ran <= 2));
+                REQUIRE(AntTQ_RunPending(tq, 0, 1) == 1);
+                REQUIRE(AntTQ_RunPending(tq, 0, 0) == 4 - ran);
+            }
+        }
+
+        WHEN("全 Worker 宛てタスクを予約する") {
+            THEN("失敗すること") {
+                REQUIRE(AntTQ_Broadcast(tq, &item) == -1);
+                REQUIRE(errno == EINVAL);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("実行中のタスクに取り消し要求を通知できること", tags("taskq", "cancel")) {
+    GIVEN("タスクキューを容量 10, ワーカー 2 で初期化する") {
+        struct TaskQueue *tq{AntTQ_Init(10, 2)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        std::atomic<int> started{0};
+        std::atomic<int> stopped{0};
+        auto runner = [&](TaskId id, void *) -> bool {
+            started += 1;
+            for (int i = 0; (i < 1000) && !AntTQ_IsCancelRequested(id); ++i) {
+                msleep(1);
+            }
+            if (AntTQ_IsCancelRequested(id)) {
+                stopped += 1;
+                return false;
+            }
+            return true;
+        };
+        struct TaskItem item{TASK_ITEM_INITIALIZER};
+        item.Task = Lambda::cify<bool, TaskId, void *>(runner);
+
+        WHEN("実行中のタスクを識別子で取り消す") {
+            TaskId id = AntTQ_Enqueue(tq, &item);
+            REQUIRE(id >= 0);
+            while (started == 0) {
+                msleep(1);
+            }
+            REQUIRE(!AntTQ_IsCancelRequested(id));
+            REQUIRE(AntTQ_Cancel(tq, id) == 0);
+
+            THEN("タスクが取り消し要求を確認して処理を打ち切ること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(stopped == 1);
+                REQUIRE(AntTQ_Cancel(tq, id) == -1);
+                REQUIRE(errno == ENOENT);
+            }
+        }
+
+        WHEN("実行中のタスクをタグで取り消す") {
+            item.tag = 3;
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            while (started < 2) {
+                msleep(1);
+            }
+            REQUIRE(AntTQ_CancelTag(tq, 3) == 0);
+
+            THEN("すべてのタスクが処理を打ち切ること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(stopped == 2);
+            }
+        }
+
+        WHEN("別のタスクの取り消し要求を確認する") {
+            std::atomic<bool> observed{false};
+            std::atomic<TaskId> target{-1};
+            auto waiter = [&](TaskId, void *) -> bool {
+                started += 1;
+                for (int i = 0; (i < 1000) && !observed; ++i) {
+                    msleep(1);
+                }
+                return true;
+            };
+            auto watcher = [&](TaskId, void *) -> bool {
+                for (int i = 0; (i < 1000) && !AntTQ_IsCancelRequested(target); ++i) {
+                    msleep(1);
+                }
+                observed = AntTQ_IsCancelRequested(target);
+                return true;
+            };
+            item.Task = Lambda::cify<bool, TaskId, void *>(waiter);
+            target = AntTQ_Enqueue(tq, &item);
+            REQUIRE(target >= 0);
+            while (started == 0) {
+                msleep(1);
+            }
+            struct TaskItem other{TASK_ITEM_INITIALIZER};
+            other.Task = Lambda::cify<bool, TaskId, void *>(watcher);
+            REQUIRE(AntTQ_Enqueue(tq, &other) >= 0);
+            msleep(20);
+            REQUIRE(!observed);
+            REQUIRE(AntTQ_Cancel(tq, target) == 0);
+
+            THEN("取り消し要求を確認できること") {
+                /* 非同期処理が終わるのを待つ. */
+                msleep(100);
+                REQUIRE(observed);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
+
+SCENARIO("ファイバーで実行するタスクが Worker を塞がずに待てること", tags("taskq", "fiber")) {
+    struct TaskQueueAttr attr{TASK_QUEUE_ATTR_INITIALIZER};
+    struct TaskItem item{TASK_ITEM_INITIALIZER};
+    item.fiber = true;
+
+    GIVEN("ファイバー 2 つを持つタスクキューを容量 10, ワーカー 1 で初期化する") {
+        attr.fiber_stacks = 2;
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        WHEN("外部の事象を待つタスクの後に, 事象を起こすタスクを予約する") {
+            std::atomic<bool> signaled{false};
+            std::atomic<bool> finished{false};
+            auto waiter = [&](TaskId, void *) -> bool {
+                while (!signaled) {
+                    if (AntTQ_YieldFiber() != 0) {
+                        return false;
+                    }
+                }
+                finished = true;
+                return true;
+            };
+            auto signaler = [&](TaskId, void *) -> bool {
+                signaled = true;
+                return true;
+            };
+            item.Task = Lambda::cify<bool, TaskId, void *>(waiter);
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            struct TaskItem other{TASK_ITEM_INITIALIZER};
+            other.Task = Lambda::cify<bool, TaskId, void *>(signaler);
+            REQUIRE(AntTQ_Enqueue(tq, &other) >= 0);
+
+            THEN("唯一の Worker で両方のタスクが完了すること") {
+                for (int i = 0; (i < 1000) && !finished; ++i) {
+                    msleep(1);
+                }
+                REQUIRE(signaled);
+                REQUIRE(finished);
+            }
+        }
+
+        WHEN("タスクの中で予約したタスクの完了を待つ") {
+            std::atomic<int> value{0};
+            std::atomic<int> observed{-1};
+            auto producer = [&](TaskId, void *) -> bool {
+                msleep(10);
+                value = 42;
+                return true;
+            };
+            auto consumer = [&](TaskId, void *) -> bool {
+                struct TaskItem other{TASK_ITEM_INITIALIZER};
+                other.Task = Lambda::cify<bool, TaskId, void *>(producer);
+                TaskId id = AntTQ_Enqueue(tq, &other);
+                if ((id >= 0) && (AntTQ_Await(id) == 0)) {
+                    observed = value.load();
+                }
+                return true;
+            };
+            item.Task = Lambda::cify<bool, TaskId, void *>(consumer);
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+
+            THEN("待っていたタスクの結果を参照できること") {
+                for (int i = 0; (i < 1000) && (observed == -1); ++i) {
+                    msleep(1);
+                }
+                REQUIRE(observed == 42);
+            }
+        }
+
+        WHEN("停止中の Task Queue に予約したタスクの完了を待つ") {
+            std::atomic<bool> stopped{false};
+            std::atomic<bool> awaiting{false};
+            std::atomic<int> awaited{-2};
+            auto awaiter = [&](TaskId, void *) -> bool {
+                while (!stopped) {
+                    if (AntTQ_YieldFiber() != 0) {
+                        return false;
+                    }
+                }
+                struct TaskItem other{TASK_ITEM_INITIALIZER};
+                other.Task = [](TaskId, void *) -> bool { return true; };
+                TaskId id = AntTQ_Enqueue(tq, &other);
+                awaiting = true;
+                awaited = AntTQ_Await(id);
+                return true;
+            };
+            item.Task = Lambda::cify<bool, TaskId, void *>(awaiter);
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            msleep(10);
+            AntTQ_Stop(tq);
+            stopped = true;
+            for (int i = 0; (i < 1000) && !awaiting; ++i) {
+                msleep(1);
+            }
+            msleep(10);
+
+            struct timespec begin, end;
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &begin);
+            msleep(100);
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+            int64_t cpu_ms = ((end.tv_sec - begin.tv_sec) * 1000)
+                             + ((end.tv_nsec - begin.tv_nsec) / 1000000);
+            AntTQ_Start(tq);
+
+            THEN("待つ間 Worker は休止し, 完了で再開されること") {
+                REQUIRE(awaiting);
+                REQUIRE(cpu_ms < 50);
+                for (int i = 0; (i < 1000) && (awaited == -2); ++i) {
+                    msleep(1);
+                }
+                REQUIRE(awaited == 0);
+            }
+        }
+
+        WHEN("タスクの外から待つ") {
+            THEN("失敗すること") {
+                REQUIRE(AntTQ_Await(0) == -1);
+                REQUIRE(errno == EPERM);
+                REQUIRE(AntTQ_YieldFiber() == -1);
+                REQUIRE(errno == EPERM);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("ファイバー 40 個を持つタスクキューを容量 4, ワーカー 1 で初期化する") {
+        attr.fiber_stacks = 40;
+        struct TaskQueue *tq{AntTQ_InitAttr(4, 1, &attr)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        WHEN("すべてのファイバーを中断させてから, キューを満杯にする") {
+            std::atomic<bool> released{false};
+            std::atomic<int> parked{0};
+            std::atomic<int> finished{0};
+            auto waiter = [&](TaskId, void *) -> bool {
+                parked += 1;
+                while (!released) {
+                    if (AntTQ_YieldFiber() != 0) {
+                        return false;
+                    }
+                }
+                finished += 1;
+                return true;
+            };
+            item.Task = Lambda::cify<bool, TaskId, void *>(waiter);
+            for (int i = 0; i < 40; ++i) {
+                TaskId id;
+                for (int retry = 0; ((id = AntTQ_Enqueue(tq, &item)) < 0) && (retry < 1000); ++retry) {
+                    msleep(1);
+                }
+                REQUIRE(id >= 0);
+            }
+            for (int i = 0; (i < 1000) && (parked < 40); ++i) {
+                msleep(1);
+            }
+            REQUIRE(parked == 40);
+
+            AntTQ_Stop(tq);
+            struct TaskItem other{TASK_ITEM_INITIALIZER};
+            other.Task = [](TaskId, void *) -> bool { return true; };
+            int filled = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (AntTQ_Enqueue(tq, &other) >= 0) {
+                    filled += 1;
+                }
+            }
+            released = true;
+            AntTQ_Start(tq);
+
+            THEN("中断中のファイバーの数に関わらず, 容量まで予約できること") {
+                REQUIRE(filled == 4);
+                for (int i = 0; (i < 1000) && (finished < 40); ++i) {
+                    msleep(1);
+                }
+                REQUIRE(finished == 40);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+
+    GIVEN("ファイバー 2 つを持つタスクキューを容量 10, ワーカー 1 で初期化する") {
+        attr.fiber_stacks = 2;
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        WHEN("停止中の Task Queue に予約したタスクの完了を待つ間に終了する") {
+            std::atomic<bool> stopped{false};
+            std::atomic<bool> awaiting{false};
+            std::atomic<int> status{-1};
+            auto awaiter = [&](TaskId, void *) -> bool {
+                while (!stopped) {
+                    if (AntTQ_YieldFiber() != 0) {
+                        return false;
+                    }
+                }
+                struct TaskItem other{TASK_ITEM_INITIALIZER};
+                other.Task = [](TaskId, void *) -> bool { return true; };
+                TaskId id = AntTQ_Enqueue(tq, &other);
+                awaiting = true;
+                AntTQ_Await(id);
+                return true;
+            };
+            auto callback = [&](TaskId, enum TaskStatus st, void *) -> bool {
+                if (st != TS_ACK) {
+                    status = st;
+                }
+                return true;
+            };
+            item.Task = Lambda::cify<bool, TaskId, void *>(awaiter);
+            item.Callback = Lambda::cify<bool, TaskId, enum TaskStatus, void *>(callback);
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            msleep(10);
+            AntTQ_Stop(tq);
+            stopped = true;
+            for (int i = 0; (i < 1000) && !awaiting; ++i) {
+                msleep(1);
+            }
+            msleep(10);
+            AntTQ_Term(tq);
+
+            THEN("中断中のファイバーのタスクに TS_CANCELED が通知されること") {
+                REQUIRE(awaiting);
+                REQUIRE(status == TS_CANCELED);
+            }
+        }
+    }
+
+    GIVEN("ファイバー 2 つを持つ Worker プールを共有するタスクキューを容量 10 で初期化する") {
+        attr.fiber_stacks = 2;
+        struct TaskPool *pool{AntTQ_PoolInit(1, &attr)};
+        REQUIRE(pool != nullptr);
+        struct TaskQueue *tq{AntTQ_InitOnPool(pool, 10, NULL)};
+        REQUIRE(tq != nullptr);
+        AntTQ_Start(tq);
+
+        WHEN("停止中の Task Queue に予約したタスクの完了を待つ間に終了する") {
+            std::atomic<bool> stopped{false};
+            std::atomic<bool> awaiting{false};
+            std::atomic<int> awaited{-2};
+            std::atomic<int> awaited_errno{0};
+            std::atomic<int> status{-1};
+            auto awaiter = [&](TaskId, void *) -> bool {
+                while (!stopped) {
+                    if (AntTQ_YieldFiber() != 0) {
+                        return false;
+                    }
+                }
+                struct TaskItem other{TASK_ITEM_INITIALIZER};
+                other.Task = [](TaskId, void *) -> bool { return true; };
+                TaskId id = AntTQ_Enqueue(tq, &other);
+                awaiting = true;
+                awaited = AntTQ_Await(id);
+                awaited_errno = errno;
+                return true;
+            };
+            auto callback = [&](TaskId, enum TaskStatus st, void *) -> bool {
+                if (st != TS_ACK) {
+                    status = st;
+                }
+                return true;
+            };
+            item.Task = Lambda::cify<bool, TaskId, void *>(awaiter);
+            item.Callback = Lambda::cify<bool, TaskId, enum TaskStatus, void *>(callback);
+            REQUIRE(AntTQ_Enqueue(tq, &item) >= 0);
+            msleep(10);
+            AntTQ_Stop(tq);
+            stopped = true;
+            for (int i = 0; (i < 1000) && !awaiting; ++i) {
+                msleep(1);
+            }
+            msleep(10);
+            AntTQ_Term(tq);
+
+            THEN("待機が打ち切られ, TS_CANCELED が通知されること") {
+                REQUIRE(awaiting);
+                REQUIRE(awaited == -1);
+                REQUIRE(awaited_errno == ECANCELED);
+                REQUIRE(status == TS_CANCELED);
+            }
+        }
+
+        AntTQ_PoolTerm(pool);
+    }
+
+    GIVEN("ファイバーを持たないタスクキューを容量 10, ワーカー 1 で初期化する") {
+        struct TaskQueue *tq{AntTQ_InitAttr(10, 1, &attr)};
+        REQUIRE(tq != nullptr);
+
+        WHEN("ファイバーで実行するタスクを予約する") {
+            item.Task = [](TaskId, void *) -> bool { return true; };
+
+            THEN("予約に失敗すること") {
+                REQUIRE(AntTQ_Enqueue(tq, &item) == -1);
+                REQUIRE(errno == EINVAL);
+            }
+        }
+
+        AntTQ_Term(tq);
+    }
+}
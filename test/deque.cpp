@@ -0,0 +1,135 @@
+/** @file   deque.cpp
+ *  @brief  ワークスティーリング両端キューのテスト.
+ *
+ *  @author t-kenji <protect.2501@gmail.com>
+ *  @date   2026-10-18 newly create.
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <catch2/catch.hpp>
+
+#include "utils.hpp"
+
+extern "C" {
+#include "deque.h"
+}
+
+SCENARIO("両端キューに必要なメモリサイズが計算できること", tags("deque")) {
+    GIVEN("特になし") {
+        WHEN("容量 2 のべき乗で計算する") {
+            struct Deque deque;
+            ssize_t deque_size = Deque_ComputeSize(&deque, sizeof(int), 16);
+
+            THEN("成功すること") {
+                REQUIRE(deque_size > 0);
+            }
+        }
+
+        WHEN("容量 2 のべき乗以外で計算する") {
+            struct Deque deque;
+            ssize_t deque_size = Deque_ComputeSize(&deque, sizeof(int), 10);
+
+            THEN("失敗すること") {
+                REQUIRE(deque_size == -1);
+                REQUIRE(errno == EINVAL);
+            }
+        }
+    }
+}
+
+SCENARIO("所有者は後入れ先出し, 他のスレッドは先入れ先出しで取得できること", tags("deque")) {
+    GIVEN("容量 4 の両端キューを作成する") {
+        struct Deque deque;
+        ssize_t deque_size = Deque_ComputeSize(&deque, sizeof(int), 4);
+        REQUIRE(deque_size > 0);
+        uint8_t *memory = new uint8_t[deque_size];
+        REQUIRE(Deque_Bind(&deque, memory) == 0);
+
+        WHEN("容量まで値を追加する") {
+            for (int i = 0; i < 4; ++i) {
+                REQUIRE(Deque_Push(&deque, &i) == 0);
+            }
+
+            THEN("それ以上は追加できず, 所有者は新しい順, 盗み出しは古い順に取得できること") {
+                int value{4};
+                REQUIRE(Deque_Push(&deque, &value) == -1);
+                REQUIRE(errno == ENOMEM);
+                REQUIRE(Deque_Pop(&deque, &value) == 0);
+                REQUIRE(value == 3);
+                REQUIRE(Deque_Steal(&deque, &value) == 0);
+                REQUIRE(value == 0);
+                REQUIRE(Deque_Pop(&deque, &value) == 0);
+                REQUIRE(value == 2);
+                REQUIRE(Deque_Steal(&deque, &value) == 0);
+                REQUIRE(value == 1);
+                REQUIRE(Deque_IsEmpty(&deque));
+                REQUIRE(Deque_Pop(&deque, &value) == -1);
+                REQUIRE(errno == ENOENT);
+                REQUIRE(Deque_Steal(&deque, &value) == -1);
+                REQUIRE(errno == ENOENT);
+            }
+        }
+
+        Deque_Unbind(&deque);
+        delete[] memory;
+    }
+}
+
+SCENARIO("複数のスレッドから盗み出せること", tags("deque")) {
+    GIVEN("容量 256 の両端キューを作成する") {
+        struct Deque deque;
+        ssize_t deque_size = Deque_ComputeSize(&deque, sizeof(int), 256);
+        REQUIRE(deque_size > 0);
+        uint8_t *memory = new uint8_t[deque_size];
+        REQUIRE(Deque_Bind(&deque, memory) == 0);
+
+        WHEN("所有者が 40000 件を追加, 取得しながら 3 スレッドが盗み出す") {
+            std::atomic<bool> done{false};
+            std::atomic<long> sum{0};
+            std::atomic<int> count{0};
+            std::vector<std::thread> thieves;
+            for (int t = 0; t < 3; ++t) {
+                thieves.emplace_back([&] {
+                    while (!done) {
+                        int value;
+                        if (Deque_Steal(&deque, &value) == 0) {
+                            sum += value;
+                            count += 1;
+                        }
+                    }
+                });
+            }
+            for (int i = 1; i <= 40000; ++i) {
+                while (Deque_Push(&deque, &i) != 0) {
+                    int value;
+                    if (Deque_Pop(&deque, &value) == 0) {
+                        sum += value;
+                        count += 1;
+                    }
+                }
+            }
+            int value;
+            while (count < 40000) {
+                if (Deque_Pop(&deque, &value) == 0) {
+                    sum += value;
+                    count += 1;
+                }
+            }
+            done = true;
+            for (auto &thief : thieves) {
+                thief.join();
+            }
+
+            THEN("すべての値を 1 度ずつ取得できること") {
+                REQUIRE(count == 40000);
+                REQUIRE(sum == 40000L * 40001L / 2);
+            }
+        }
+
+        Deque_Unbind(&deque);
+        delete[] memory;
+    }
+}
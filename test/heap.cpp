@@ -0,0 +1,102 @@
+/** @file   heap.cpp
+ *  @brief  ヒープのテスト.
+ *
+ *  @author t-kenji <protect.2501@gmail.com>
+ *  @date   2026-10-18 newly create.
+ */
+
+#include <cerrno>
+#include <catch2/catch.hpp>
+
+#include "utils.hpp"
+
+extern "C" {
+#include "heap.h"
+}
+
+SCENARIO("ヒープに必要なメモリサイズが計算できること", tags("heap")) {
+    GIVEN("特になし") {
+        WHEN("必要なメモリサイズを計算する") {
+            struct Heap heap;
+            ssize_t heap_size = Heap_ComputeSize(&heap, sizeof(int), 10);
+
+            THEN("成功すること") {
+                REQUIRE(heap_size > 0);
+            }
+        }
+
+        WHEN("容量 0 で計算する") {
+            struct Heap heap;
+            ssize_t heap_size = Heap_ComputeSize(&heap, sizeof(int), 0);
+
+            THEN("失敗すること") {
+                REQUIRE(heap_size == -1);
+                REQUIRE(errno == EINVAL);
+            }
+        }
+    }
+}
+
+SCENARIO("ヒープからキーの小さい順に値を取得できること", tags("heap")) {
+    GIVEN("ヒープを作成する") {
+        size_t capacity{8};
+        struct Heap heap;
+        ssize_t heap_size = Heap_ComputeSize(&heap, sizeof(int), capacity);
+        REQUIRE(heap_size > 0);
+        uint8_t *memory = new uint8_t[heap_size];
+        REQUIRE(Heap_Bind(&heap, memory) == 0);
+
+        WHEN("順不同に値を追加する") {
+            uint64_t keys[] = {50, 10, 70, 30, 20, 80, 60, 40};
+            for (auto key : keys) {
+                int value = static_cast<int>(key) * 2;
+                REQUIRE(Heap_Push(&heap, key, &value) == 0);
+            }
+
+            THEN("キーの小さい順に取得できること") {
+                REQUIRE(Heap_Length(&heap) == 8);
+                uint64_t top;
+                REQUIRE(Heap_Peek(&heap, &top) == 0);
+                REQUIRE(top == 10);
+                for (uint64_t expected = 10; expected <= 80; expected += 10) {
+                    uint64_t key;
+                    int value;
+                    REQUIRE(Heap_Pop(&heap, &key, &value) == 0);
+                    REQUIRE(key == expected);
+                    REQUIRE(value == static_cast<int>(expected) * 2);
+                }
+                int value;
+                REQUIRE(Heap_Pop(&heap, nullptr, &value) == -1);
+                REQUIRE(errno == ENOENT);
+            }
+        }
+
+        Heap_Unbind(&heap);
+        delete[] memory;
+    }
+}
+
+SCENARIO("ヒープの容量を超えて追加できないこと", tags("heap")) {
+    GIVEN("容量 2 のヒープを作成する") {
+        size_t capacity{2};
+        struct Heap heap;
+        ssize_t heap_size = Heap_ComputeSize(&heap, sizeof(int), capacity);
+        REQUIRE(heap_size > 0);
+        uint8_t *memory = new uint8_t[heap_size];
+        REQUIRE(Heap_Bind(&heap, memory) == 0);
+
+        WHEN("容量まで値を追加する") {
+            int value{1};
+            REQUIRE(Heap_Push(&heap, 1, &value) == 0);
+            REQUIRE(Heap_Push(&heap, 2, &value) == 0);
+
+            THEN("それ以上は失敗すること") {
+                REQUIRE(Heap_Push(&heap, 3, &value) == -1);
+                REQUIRE(errno == ENOMEM);
+            }
+        }
+
+        Heap_Unbind(&heap);
+        delete[] memory;
+    }
+}
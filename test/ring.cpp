@@ -0,0 +1,130 @@
+/** @file   ring.cpp
+ *  @brief  リングバッファのテスト.
+ *
+ *  @author t-kenji <protect.2501@gmail.com>
+ *  @date   2026-10-18 newly create.
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <catch2/catch.hpp>
+
+#include "utils.hpp"
+
+extern "C" {
+#include "ring.h"
+}
+
+SCENARIO("リングバッファに必要なメモリサイズが計算できること", tags("ring")) {
+    GIVEN("特になし") {
+        WHEN("容量 2 のべき乗で計算する") {
+            struct Ring ring;
+            ssize_t ring_size = Ring_ComputeSize(&ring, sizeof(int), 16);
+
+            THEN("成功すること") {
+                REQUIRE(ring_size > 0);
+            }
+        }
+
+        WHEN("容量 2 のべき乗以外で計算する") {
+            struct Ring ring;
+            ssize_t ring_size = Ring_ComputeSize(&ring, sizeof(int), 10);
+
+            THEN("失敗すること") {
+                REQUIRE(ring_size == -1);
+                REQUIRE(errno == EINVAL);
+            }
+        }
+    }
+}
+
+SCENARIO("リングバッファから追加順に値を取得できること", tags("ring")) {
+    GIVEN("容量 4 のリングバッファを作成する") {
+        struct Ring ring;
+        ssize_t ring_size = Ring_ComputeSize(&ring, sizeof(int), 4);
+        REQUIRE(ring_size > 0);
+        uint8_t *memory = new uint8_t[ring_size];
+        REQUIRE(Ring_Bind(&ring, memory) == 0);
+
+        WHEN("容量まで値を追加する") {
+            for (int i = 0; i < 4; ++i) {
+                REQUIRE(Ring_Push(&ring, &i, nullptr) == 0);
+            }
+
+            THEN("それ以上は追加できず, 追加順に取得できること") {
+                int value{4};
+                REQUIRE(Ring_Push(&ring, &value, nullptr) == -1);
+                REQUIRE(errno == ENOMEM);
+                for (int i = 0; i < 4; ++i) {
+                    REQUIRE(Ring_Pop(&ring, &value) == 0);
+                    REQUIRE(value == i);
+                }
+                REQUIRE(Ring_Pop(&ring, &value) == -1);
+                REQUIRE(errno == ENOENT);
+            }
+        }
+
+        WHEN("空のリングバッファに値を追加する") {
+            int value{1};
+            bool edge{false};
+            REQUIRE(Ring_Push(&ring, &value, &edge) == 0);
+
+            THEN("空から非空になった追加のみ通知されること") {
+                REQUIRE(edge);
+                REQUIRE(Ring_Push(&ring, &value, &edge) == 0);
+                REQUIRE(!edge);
+                REQUIRE(Ring_Pop(&ring, &value) == 0);
+                REQUIRE(Ring_Pop(&ring, &value) == 0);
+                REQUIRE(Ring_Push(&ring, &value, &edge) == 0);
+                REQUIRE(edge);
+            }
+        }
+
+        Ring_Unbind(&ring);
+        delete[] memory;
+    }
+}
+
+SCENARIO("複数の生産者から値を追加できること", tags("ring")) {
+    GIVEN("容量 1024 のリングバッファを作成する") {
+        struct Ring ring;
+        ssize_t ring_size = Ring_ComputeSize(&ring, sizeof(int), 1024);
+        REQUIRE(ring_size > 0);
+        uint8_t *memory = new uint8_t[ring_size];
+        REQUIRE(Ring_Bind(&ring, memory) == 0);
+
+        WHEN("4 スレッドから 10000 件ずつ追加しながら取得する") {
+            std::vector<std::thread> producers;
+            for (int t = 0; t < 4; ++t) {
+                producers.emplace_back([&ring] {
+                    for (int i = 1; i <= 10000; ++i) {
+                        while (Ring_Push(&ring, &i, nullptr) != 0) {
+                            std::this_thread::yield();
+                        }
+                    }
+                });
+            }
+            long sum{0};
+            int count{0};
+            while (count < 40000) {
+                int value;
+                if (Ring_Pop(&ring, &value) == 0) {
+                    sum += value;
+                    count += 1;
+                }
+            }
+            for (auto &producer : producers) {
+                producer.join();
+            }
+
+            THEN("すべての値を取得できること") {
+                REQUIRE(sum == 4L * (10000L * 10001L / 2));
+            }
+        }
+
+        Ring_Unbind(&ring);
+        delete[] memory;
+    }
+}
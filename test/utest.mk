@@ -1,9 +1,15 @@
 CONFIG_TEST_MEMPOOL := y
 CONFIG_TEST_QUEUE := y
+CONFIG_TEST_HEAP := y
+CONFIG_TEST_RING := y
+CONFIG_TEST_DEQUE := y
 CONFIG_TEST_ANTTQ := y
 
 test-$(CONFIG_TEST_MEMPOOL) += mempool.o
 test-$(CONFIG_TEST_QUEUE) += queue.o
+test-$(CONFIG_TEST_HEAP) += heap.o
+test-$(CONFIG_TEST_RING) += ring.o
+test-$(CONFIG_TEST_DEQUE) += deque.o
 test-$(CONFIG_TEST_ANTTQ) += anttq.o
 
 MODULE := utest
@@ -8,10 +8,20 @@
 #ifndef __ANTTQ_TEST_UTILS_H__
 #define __ANTTQ_TEST_UTILS_H__
 
+#include <atomic>
+
 #define ARRAY_SIZE(array) (sizeof(array)/sizeof(array[0]))
 
+/**
+ *  C11 の _Atomic 指定子を, 同じレイアウトの std::atomic で読み替える.
+ *  内部ヘッダの構造体をテストから扱うために使用する.
+ */
+#ifndef _Atomic
+#define _Atomic(type) std::atomic<type>
+#endif
+
 template<typename First, typename ...Rest>
-constexpr std::string tags(const First first, const Rest ...rest)
+inline std::string tags(const First first, const Rest ...rest)
 {
     const First args[] = {first, rest...};
     std::string tag_str = "";